@@ -0,0 +1,326 @@
+#include <cstring>
+#include <iostream>
+#include <getopt.h>
+#include <string>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <cstdlib>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <sstream>
+
+#include "trace.h"
+
+// Offline analysis of `rio --trace` files: arbitrary percentiles, time windows and filters over the recorded I/Os,
+// without rerunning the experiment.
+
+static void fatal_error(const char *msg)
+{
+	std::cerr << "Fatal: " << msg << std::endl;
+	std::exit(1);
+}
+
+struct Filter
+{
+	int op = -1;     // TraceOp, -1 for any
+	int worker = -1; // -1 for any
+	uint64_t lba_min = 0;
+	uint64_t lba_max = UINT64_MAX;
+	double from_sec = 0; // submit time window
+	double to_sec = INFINITY;
+	bool include_failed = false;
+};
+
+struct Options
+{
+	const char *path = nullptr;
+	std::vector<double> percentiles = {50, 90, 99, 99.9, 99.99};
+	double window_sec = 0; // 0 reports the whole trace as one window
+	Filter filter;
+};
+
+static void usage(const char *prog)
+{
+	std::cerr << "Usage: " << prog << " [options] <trace>\n"
+	          << "  --percentiles=<list>  Comma-separated percentiles (default 50,90,99,99.9,99.99)\n"
+	          << "  --window=<ms>         Report per completion-time window instead of the whole trace\n"
+	          << "  --op=<op>             Only read or write I/Os\n"
+	          << "  --worker=<n>          Only I/Os issued by worker <n>\n"
+	          << "  --lba_min=<lba>       Only I/Os starting at or above <lba>\n"
+	          << "  --lba_max=<lba>       Only I/Os starting at or below <lba>\n"
+	          << "  --from=<sec>          Only I/Os submitted at or after <sec>\n"
+	          << "  --to=<sec>            Only I/Os submitted before <sec>\n"
+	          << "  --include_failed      Include I/Os that completed with an error\n";
+	exit(1);
+}
+
+static std::vector<double> parse_percentiles(const char *str)
+{
+	std::vector<double> out;
+	const char *p = str;
+	while (*p)
+	{
+		char *end;
+		double v = strtod(p, &end);
+		if (end == p || v < 0 || v > 100)
+		{
+			std::cerr << "Invalid percentile list: " << str << std::endl;
+			exit(1);
+		}
+		out.push_back(v);
+		p = (*end == ',') ? end + 1 : end;
+	}
+	return out;
+}
+
+static Options parse_args(int argc, char **argv)
+{
+	Options opts;
+
+	static struct option long_options[] = {{"percentiles", required_argument, 0, 'p'},
+	                                       {"window", required_argument, 0, 'w'},
+	                                       {"op", required_argument, 0, 'o'},
+	                                       {"worker", required_argument, 0, 'k'},
+	                                       {"lba_min", required_argument, 0, 'l'},
+	                                       {"lba_max", required_argument, 0, 'L'},
+	                                       {"from", required_argument, 0, 'f'},
+	                                       {"to", required_argument, 0, 't'},
+	                                       {"include_failed", no_argument, 0, 'e'},
+	                                       {0, 0, 0, 0}};
+
+	int opt;
+	while ((opt = getopt_long(argc, argv, "", long_options, nullptr)) != -1)
+	{
+		switch (opt)
+		{
+		case 'p':
+			opts.percentiles = parse_percentiles(optarg);
+			break;
+		case 'w':
+			opts.window_sec = atof(optarg) / 1000.0;
+			break;
+		case 'o':
+			if (strcmp(optarg, "read") == 0)
+			{
+				opts.filter.op = TRACE_READ;
+			}
+			else if (strcmp(optarg, "write") == 0)
+			{
+				opts.filter.op = TRACE_WRITE;
+			}
+			else
+			{
+				std::cerr << "Invalid op: " << optarg << std::endl;
+				usage(argv[0]);
+			}
+			break;
+		case 'k':
+			opts.filter.worker = atoi(optarg);
+			break;
+		case 'l':
+			opts.filter.lba_min = strtoull(optarg, nullptr, 0);
+			break;
+		case 'L':
+			opts.filter.lba_max = strtoull(optarg, nullptr, 0);
+			break;
+		case 'f':
+			opts.filter.from_sec = atof(optarg);
+			break;
+		case 't':
+			opts.filter.to_sec = atof(optarg);
+			break;
+		case 'e':
+			opts.filter.include_failed = true;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (optind != argc - 1)
+	{
+		usage(argv[0]);
+	}
+	opts.path = argv[optind];
+	return opts;
+}
+
+static bool matches(const TraceEvent &ev, const Filter &f)
+{
+	if (f.op >= 0 && ev.op != (uint64_t)f.op)
+		return false;
+	if (f.worker >= 0 && ev.worker != (uint64_t)f.worker)
+		return false;
+	if (ev.lba < f.lba_min || ev.lba > f.lba_max)
+		return false;
+	if (ev.failed && !f.include_failed)
+		return false;
+	double submit_sec = ev.submit_ns / 1e9;
+	return submit_sec >= f.from_sec && submit_sec < f.to_sec;
+}
+
+// Same interpolation as rio's own report so the numbers are directly comparable
+static double percentile(const std::vector<uint64_t> &sorted, double p)
+{
+	if (sorted.empty())
+		return 0.0;
+	double index = (p / 100.0) * (sorted.size() - 1);
+	size_t lower = (size_t)index;
+	size_t upper = lower + 1;
+	if (upper >= sorted.size())
+		return sorted.back();
+	double frac = index - lower;
+	return sorted[lower] * (1 - frac) + sorted[upper] * frac;
+}
+
+struct Window
+{
+	std::vector<uint64_t> latencies; // ns
+	uint64_t bytes = 0;
+	uint64_t first_submit_ns = UINT64_MAX;
+	uint64_t last_complete_ns = 0;
+};
+
+static void print_summary(const Options &opts, Window &w)
+{
+	std::sort(w.latencies.begin(), w.latencies.end());
+	double elapsed = w.latencies.empty() ? 0 : (w.last_complete_ns - w.first_submit_ns) / 1e9;
+	double avg = 0;
+	for (uint64_t lat : w.latencies)
+	{
+		avg += lat;
+	}
+	avg = w.latencies.empty() ? 0 : avg / w.latencies.size() / 1000.0;
+
+	std::cout << "Results:\n";
+	std::cout << "  I/Os:       " << w.latencies.size() << "\n";
+	std::cout << "  Duration:   " << std::fixed << std::setprecision(3) << elapsed << " s\n";
+	std::cout << "  IOPS:       " << std::fixed << std::setprecision(0)
+	          << (elapsed > 0 ? w.latencies.size() / elapsed : 0) << "\n";
+	std::cout << "  Bandwidth:  " << std::fixed << std::setprecision(2)
+	          << (elapsed > 0 ? w.bytes / (elapsed * 1024 * 1024) : 0) << " MB/s\n";
+	std::cout << "  Latency (us):\n";
+	std::cout << "    avg:      " << std::fixed << std::setprecision(2) << avg << "\n";
+	std::cout << "    min:      " << (w.latencies.empty() ? 0 : w.latencies.front() / 1000.0) << "\n";
+	for (double p : opts.percentiles)
+	{
+		std::ostringstream label;
+		label << "p" << std::defaultfloat << p << ":";
+		std::cout << "    " << std::left << std::setw(10) << label.str() << std::right << std::fixed
+		          << std::setprecision(2) << percentile(w.latencies, p) / 1000.0 << "\n";
+	}
+	std::cout << "    max:      " << (w.latencies.empty() ? 0 : w.latencies.back() / 1000.0) << "\n";
+}
+
+static void print_windows(const Options &opts, std::vector<Window> &windows)
+{
+	std::cout << std::setw(10) << "start(s)" << std::setw(12) << "ios" << std::setw(12) << "iops" << std::setw(12)
+	          << "avg(us)";
+	for (double p : opts.percentiles)
+	{
+		std::ostringstream label;
+		label << "p" << p << "(us)";
+		std::cout << std::setw(14) << label.str();
+	}
+	std::cout << "\n";
+
+	for (size_t i = 0; i < windows.size(); i++)
+	{
+		Window &w = windows[i];
+		std::sort(w.latencies.begin(), w.latencies.end());
+		double avg = 0;
+		for (uint64_t lat : w.latencies)
+		{
+			avg += lat;
+		}
+		avg = w.latencies.empty() ? 0 : avg / w.latencies.size() / 1000.0;
+
+		std::cout << std::fixed << std::setprecision(3) << std::setw(10) << i * opts.window_sec << std::setw(12)
+		          << w.latencies.size() << std::setprecision(0) << std::setw(12) << w.latencies.size() / opts.window_sec
+		          << std::setprecision(2) << std::setw(12) << avg;
+		for (double p : opts.percentiles)
+		{
+			std::cout << std::setw(14) << percentile(w.latencies, p) / 1000.0;
+		}
+		std::cout << "\n";
+	}
+}
+
+int main(int argc, char **argv)
+{
+	Options opts = parse_args(argc, argv);
+
+	int fd = open(opts.path, O_RDONLY);
+	if (fd < 0)
+	{
+		fatal_error("Failed to open trace");
+	}
+	struct stat st;
+	if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(TraceHeader))
+	{
+		fatal_error("Trace is too short");
+	}
+	void *map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (map == MAP_FAILED)
+	{
+		fatal_error("Failed to map trace");
+	}
+	madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+	const TraceHeader *hdr = (const TraceHeader *)map;
+	if (memcmp(hdr->magic, TRACE_MAGIC, sizeof(TRACE_MAGIC)) != 0 || hdr->version != TRACE_VERSION ||
+	    hdr->event_size != sizeof(TraceEvent))
+	{
+		fatal_error("Not a rio trace, or an incompatible version");
+	}
+	if (TRACE_HEADER_SIZE + hdr->events * sizeof(TraceEvent) > (uint64_t)st.st_size)
+	{
+		fatal_error("Trace is truncated");
+	}
+	const TraceEvent *events = (const TraceEvent *)((const char *)map + TRACE_HEADER_SIZE);
+
+	std::cout << "Trace: " << hdr->events << " events, " << hdr->workers << " worker(s), LBA size " << hdr->lba_size;
+	if (hdr->dropped > 0)
+	{
+		std::cout << ", " << hdr->dropped << " dropped while recording";
+	}
+	std::cout << "\n\n";
+
+	// Events are neither time-ordered nor grouped by worker (see trace.h), so each one is filtered and binned alone
+	Window all;
+	std::vector<Window> windows;
+	for (uint64_t i = 0; i < hdr->events; i++)
+	{
+		const TraceEvent &ev = events[i];
+		if (!matches(ev, opts.filter))
+			continue;
+
+		Window *w = &all;
+		if (opts.window_sec > 0)
+		{
+			size_t idx = (size_t)(ev.complete_ns / 1e9 / opts.window_sec);
+			if (windows.size() <= idx)
+			{
+				windows.resize(idx + 1);
+			}
+			w = &windows[idx];
+		}
+		w->latencies.push_back(ev.complete_ns - ev.submit_ns);
+		w->bytes += (ev.blocks + 1) * hdr->lba_size;
+		w->first_submit_ns = std::min<uint64_t>(w->first_submit_ns, ev.submit_ns);
+		w->last_complete_ns = std::max<uint64_t>(w->last_complete_ns, ev.complete_ns);
+	}
+
+	if (opts.window_sec > 0)
+		print_windows(opts, windows);
+	else
+		print_summary(opts, all);
+
+	munmap(map, st.st_size);
+	close(fd);
+	return 0;
+}
@@ -8,6 +8,7 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <linux/fs.h>
+#include <linux/ioprio.h>
 #include <sys/ioctl.h>
 #include <filesystem>
 #include <regex>
@@ -19,6 +20,35 @@
 #include <numeric>
 #include <cmath>
 #include <iomanip>
+#include <atomic>
+#include <map>
+#include <set>
+#include <array>
+#include <bit>
+#include <fstream>
+#include <sstream>
+#include <cinttypes>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/prctl.h>
+#include <poll.h>
+#include <sched.h>
+#include <pthread.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include "trace.h"
 
 static void fatal_error(const char *msg, int err = 0)
 {
@@ -31,6 +61,84 @@ static void fatal_error(const char *msg, int err = 0)
 	std::exit(1);
 }
 
+// Allocation guard (make allocguard): every malloc family call goes through these wrappers, including operator new,
+// which libstdc++ builds on malloc. Workers arm the guard once their queue is filled and disarm it when the phase
+// drains, so whatever is allocated in between is a steady-state allocation on the I/O path. RIO_ALLOC_GUARD=1
+// counts them and fails the run; RIO_ALLOC_GUARD=2 aborts at the first one so a debugger shows where it came from.
+#ifdef RIO_ALLOC_GUARD
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t n, size_t size);
+extern "C" void *__libc_realloc(void *ptr, size_t size);
+extern "C" void *__libc_memalign(size_t alignment, size_t size);
+
+struct AllocGuard
+{
+	bool armed = false;
+	uint64_t allocations = 0;
+	uint64_t bytes = 0;
+};
+
+static thread_local AllocGuard alloc_guard;
+
+static void alloc_guard_check(size_t size)
+{
+	if (!alloc_guard.armed)
+	{
+		return;
+	}
+	alloc_guard.allocations++;
+	alloc_guard.bytes += size;
+	if (RIO_ALLOC_GUARD == 2)
+	{
+		alloc_guard.armed = false;
+		static const char msg[] = "Fatal: allocation on the I/O path (RIO_ALLOC_GUARD)\n";
+		(void)!write(STDERR_FILENO, msg, sizeof(msg) - 1);
+		abort();
+	}
+}
+
+extern "C" void *malloc(size_t size)
+{
+	alloc_guard_check(size);
+	return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t n, size_t size)
+{
+	alloc_guard_check(n * size);
+	return __libc_calloc(n, size);
+}
+
+extern "C" void *realloc(void *ptr, size_t size)
+{
+	alloc_guard_check(size);
+	return __libc_realloc(ptr, size);
+}
+
+extern "C" void *memalign(size_t alignment, size_t size)
+{
+	alloc_guard_check(size);
+	return __libc_memalign(alignment, size);
+}
+
+extern "C" void *aligned_alloc(size_t alignment, size_t size)
+{
+	alloc_guard_check(size);
+	return __libc_memalign(alignment, size);
+}
+
+extern "C" int posix_memalign(void **ptr, size_t alignment, size_t size)
+{
+	if (alignment % sizeof(void *) != 0 || (alignment & (alignment - 1)) != 0)
+	{
+		return EINVAL;
+	}
+	alloc_guard_check(size);
+	*ptr = __libc_memalign(alignment, size);
+	return *ptr ? 0 : ENOMEM;
+}
+#endif
+
 enum class SubmitMode
 {
 	SUBMIT_AND_WAIT, // io_uring_submit_and_wait(): submit + block until CQEs ready
@@ -48,7 +156,54 @@ struct Config
 	size_t block_size = 0;
 	bool passthrough = false; // O_DIRECT by default
 	bool iopoll = false;      // Use IORING_SETUP_IOPOLL for polled completions
+	bool hugepage_rings = false; // Rings in huge pages provided by rio (IORING_SETUP_NO_MMAP)
 	SubmitMode submit_mode = SubmitMode::SUBMIT_AND_WAIT;
+	const char *metrics_file = nullptr;   // OpenMetrics textfile, rewritten every metrics_interval
+	const char *metrics_socket = nullptr; // OpenMetrics served over a unix socket
+	int metrics_interval = 10;            // seconds
+	bool verify = false;                  // Stamp writes / check reads with self-describing block headers
+	uint64_t verify_seed = 0x72696f;      // Seeds the block payload pattern; must match between write and read runs
+	int buffer_compress_percentage = -1;  // -1 leaves write buffers as allocated
+	int dedupe_percentage = 0;            // share of writes that repeat content from the dedupe buffers
+	int buffer_pool = 0;                  // buffers shared round-robin by the I/O slots; 0 gives each slot its own
+	unsigned continue_on_error = 0;       // CONTINUE_ON_* mask of op types whose errors are counted, not fatal
+	int error_retries = 0;                // resubmissions of a failed I/O before it counts as failed
+	int io_timeout_ms = 0;                // 0 disables hung-command detection
+	int slowest = 0;                      // keep the N slowest I/Os with full context
+	int slow_threshold_us = 0;            // log every I/O at least this slow; 0 disables
+	bool queue_stats = false;             // time-weighted queue occupancy and Little's law check
+	const char *heatmap = nullptr;        // CSV path prefix for the latency heatmaps
+	int heatmap_regions = 64;             // LBA regions (rounded to a power-of-two region size)
+	int heatmap_interval_ms = 1000;       // time resolution of the latency-over-time heatmap
+	const char *trace = nullptr;          // binary per-I/O event trace (see trace.h)
+	uint64_t seed = 0;                    // derives each worker's random stream; 0 seeds from std::random_device
+	const char *record_offsets = nullptr; // write every worker's LBA sequence to this file
+	const char *replay_offsets = nullptr; // issue the LBA sequences recorded in this file instead
+	const char *name = nullptr;           // job name, set for --name / job file sections
+	int numjobs = 1;                      // workers running this job, each with its own ring
+	uint64_t rate_iops = 0;               // IOPS cap for the job, split across its workers; 0 is unlimited
+	uint16_t ioprio = 0;                  // --prio as an IOPRIO_PRIO_VALUE; 0 leaves I/Os at the default priority
+	int prio_percentage = 100;            // share of I/Os issued with --prio
+	uint64_t offset = 0;                  // bytes; start of the region the job's I/O is confined to
+	uint64_t io_range = 0;                // bytes; size of that region, 0 for the rest of the device
+	uint64_t offset_increment = 0;        // bytes; each worker's region starts this much after the previous one
+	const char *namespaces = nullptr;     // "all" or nsid list: run the job on these namespaces of its controller
+	bool isolation = false;               // also run every job alone and compare its latency with the shared run
+	bool queue_layout = false;            // --numjobs=hwq: one worker per hardware queue, pinned to one of its CPUs
+	std::vector<int> worker_cpus;         // CPU of each worker, filled in from the blk-mq topology
+	const char *sync_name = nullptr;      // --sync: shared memory rendezvous joined by sync_processes processes
+	int sync_processes = 0;
+	bool rt = false;                      // --rt: mlockall, SCHED_FIFO workers and an environment report
+	bool rt_nothp = false;                // --rt=nothp: also disable transparent huge pages for the process
+	int server_port = 0;                  // --server: run as an agent for --client coordinators on this TCP port
+	const char *server_addr = nullptr;    // --server: address to listen on (loopback unless given)
+	const char *client = nullptr;         // --client: comma-separated host[:port] agents to run the scenario on
+};
+
+enum ContinueOnError : unsigned
+{
+	CONTINUE_ON_READ = 1 << 0,
+	CONTINUE_ON_WRITE = 1 << 1,
 };
 
 struct NVMeDevice
@@ -62,710 +217,5856 @@ struct NVMeDevice
 using Clock = std::chrono::steady_clock;
 using TimePoint = Clock::time_point;
 
-struct IOContext
+// Per-slot state. A submit or completion touches all of it, so each slot gets exactly one cache line of its own rather
+// than straddling two; the slot's SQE is prebuilt separately (see build_sqe_template).
+struct alignas(64) IOContext
 {
 	void *buffer;
-	TimePoint submit_time;
+	TimePoint submit_time = TimePoint::max(); // max() while the slot is idle
+	uint64_t lba = UINT64_MAX;                // starting LBA of the in-flight I/O
+	uint64_t generation = 0;                  // verify mode: write sequence number stamped into the blocks
+	int retries = 0;                          // error retries spent on the current I/O
+	int queue_depth = 0;                      // I/Os in flight when this one was submitted, itself included
+	uint16_t ioprio = 0;                      // priority the in-flight I/O was issued with
+	bool timed_out = false;                   // exceeded --io_timeout; cancel requested
+	int8_t dedupe_buf = -1;                   // dedupe buffer the in-flight write came from; -1 for `buffer`
 };
 
-static size_t parse_size(const char *str)
+static_assert(sizeof(IOContext) == 64, "one cache line per I/O slot");
+
+// Rings get a CQ of twice the queue depth, and the kernel allows at most 64Ki CQ entries
+constexpr int MAX_IODEPTH = 32768;
+
+// Log-linear latency histogram bucketing (nanoseconds). Values below HIST_SUB_BUCKETS map 1:1; above that, each
+// power-of-two range is split into HIST_SUB_BUCKETS linear sub-buckets, bounding the relative error to ~6%.
+constexpr int HIST_SUB_BITS = 4;
+constexpr int HIST_SUB_BUCKETS = 1 << HIST_SUB_BITS;
+constexpr int HIST_BUCKETS = (64 - HIST_SUB_BITS + 1) * HIST_SUB_BUCKETS;
+
+// SubBits selects the resolution; the exporter uses HIST_SUB_BITS, distributed runs a finer one
+template <int SubBits = HIST_SUB_BITS>
+static inline int hist_bucket(uint64_t ns)
 {
-	char *end;
+	constexpr int sub_buckets = 1 << SubBits;
+	if (ns < sub_buckets)
+		return (int)ns;
+	int shift = 63 - __builtin_clzll(ns) - SubBits;
+	return (shift + 1) * sub_buckets + (int)((ns >> shift) & (sub_buckets - 1));
+}
 
-	size_t val = strtoull(str, &end, 10);
+// Exclusive upper bound (ns) of a histogram bucket
+template <int SubBits = HIST_SUB_BITS>
+static inline uint64_t hist_bucket_upper(int idx)
+{
+	constexpr int sub_buckets = 1 << SubBits;
+	if (idx < sub_buckets)
+		return idx + 1;
+	if (idx == (64 - SubBits + 1) * sub_buckets - 1)
+		return UINT64_MAX;
+	int shift = idx / sub_buckets - 1;
+	uint64_t sub = idx % sub_buckets;
+	return (sub_buckets + sub + 1) << shift;
+}
 
-	if (*end == '\0')
-		return val;
-	switch (*end)
+// Single-writer counter update: a relaxed load/store pair instead of a locked read-modify-write
+static inline void bump(std::atomic<uint64_t> &counter, uint64_t delta)
+{
+	counter.store(counter.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+}
+
+// Counters published by the I/O loop for the metrics exporter. Only the I/O loop writes them; the exporter thread
+// reads them with relaxed loads and does all aggregation and formatting, so the per-I/O cost is a few plain stores.
+struct alignas(64) LiveStats
+{
+	std::atomic<uint64_t> ops {0};
+	std::atomic<uint64_t> bytes {0};
+	std::atomic<uint64_t> latency_ns_sum {0};
+	std::atomic<uint64_t> errors {0};
+	std::atomic<uint64_t> hist[HIST_BUCKETS] {};
+
+	void record(uint64_t latency_ns, uint64_t nbytes)
 	{
-	case 'k':
-	case 'K':
-		return val * 1024ULL;
-	case 'm':
-	case 'M':
-		return val * 1024ULL * 1024ULL;
-	case 'g':
-	case 'G':
-		return val * 1024ULL * 1024ULL * 1024ULL;
-	default:
-		std::cerr << "Invalid size suffix: " << end << std::endl;
-		exit(1);
+		bump(ops, 1);
+		bump(bytes, nbytes);
+		bump(latency_ns_sum, latency_ns);
+		bump(hist[hist_bucket(latency_ns)], 1);
+	}
+};
+
+// Software CRC32C (Castagnoli, reflected 0x82F63B78), used when SSE4.2 is unavailable
+static uint32_t crc32c_table[256];
+
+static void crc32c_init_table()
+{
+	for (uint32_t i = 0; i < 256; i++)
+	{
+		uint32_t crc = i;
+		for (int k = 0; k < 8; k++)
+		{
+			crc = (crc >> 1) ^ (crc & 1 ? 0x82F63B78 : 0);
+		}
+		crc32c_table[i] = crc;
 	}
 }
 
-static void usage(const char *prog)
+static uint32_t crc32c_sw(uint32_t crc, const uint8_t *p, size_t len)
 {
-	std::cerr << "Usage: " << prog << " [options]\n"
-	          << "  --filename=<path>   Target device or file\n"
-	          << "  --type=<type>       I/O pattern (randread, randwrite)\n"
-	          << "  --size=<size>       Total workload size (e.g., 1g, 512m)\n"
-	          << "  --runtime=<sec>     Run for specified seconds (alternative to --size)\n"
-	          << "  --iodepth=<num>     Queue depth\n"
-	          << "  --bs=<size>         Block size (e.g., 4k)\n"
-	          << "  --mode=<mode>       I/O mode: direct (default), passthrough\n"
-	          << "  --submit=<mode>     Submission mode:\n"
-	          << "                        submit_and_wait - submit + block (default)\n"
-	          << "                        submit          - separate submit and wait calls\n"
-	          << "                        sqpoll          - kernel thread polls SQ\n"
-	          << "  --iopoll            Enable polled completions (requires poll queue support)\n";
-	exit(1);
+	while (len--)
+	{
+		crc = crc32c_table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+	}
+	return crc;
 }
 
-static Config parse_args(int argc, char **argv)
+#if defined(__x86_64__)
+// Multiplier that advances a raw CRC register over `bytes` zero bytes when applied with crc32c_shift().
+// clmul(r, k) followed by a crc32 reduction of the 64-bit product yields r * k * x^33, hence x^(8*bytes - 33).
+static uint32_t crc32c_shift_constant(size_t bytes)
 {
-	Config cfg;
+	uint32_t k = 0x80000000; // x^0 in reflected bit order
+	for (size_t i = 0; i < 8 * bytes - 33; i++)
+	{
+		k = (k >> 1) ^ (k & 1 ? 0x82F63B78 : 0);
+	}
+	return k;
+}
 
-	static struct option long_options[] = {{"filename", required_argument, 0, 'f'},
-	                                       {"type", required_argument, 0, 't'},
-	                                       {"size", required_argument, 0, 's'},
-	                                       {"runtime", required_argument, 0, 'r'},
-	                                       {"iodepth", required_argument, 0, 'd'},
-	                                       {"bs", required_argument, 0, 'b'},
-	                                       {"mode", required_argument, 0, 'm'},
-	                                       {"submit", required_argument, 0, 'u'},
-	                                       {"iopoll", no_argument, 0, 'p'},
-	                                       {0, 0, 0, 0}};
+__attribute__((target("sse4.2,pclmul"))) static inline uint32_t crc32c_shift(uint32_t crc, uint32_t k)
+{
+	__m128i prod = _mm_clmulepi64_si128(_mm_cvtsi32_si128((int)crc), _mm_cvtsi32_si128((int)k), 0x00);
+	return (uint32_t)_mm_crc32_u64(0, (uint64_t)_mm_cvtsi128_si64(prod));
+}
 
-	int opt;
-	while ((opt = getopt_long(argc, argv, "", long_options, nullptr)) != -1)
+// Hardware CRC32C. The crc32 instruction has a 3-cycle latency but 1-cycle throughput, so long inputs are split
+// into three interleaved streams whose partial CRCs are merged with carry-less multiplies.
+__attribute__((target("sse4.2,pclmul"))) static uint32_t crc32c_hw(uint32_t crc, const uint8_t *p, size_t len)
+{
+	static thread_local size_t cached_stride = 0;
+	static thread_local uint32_t cached_k = 0;
+
+	if (len >= 3 * 256)
 	{
-		switch (opt)
+		size_t stride = (len / 3) & ~(size_t)7;
+		if (stride != cached_stride)
 		{
-		case 'f':
-			cfg.filename = optarg;
-			break;
-		case 't':
-			cfg.type = optarg;
-			break;
-		case 's':
-			cfg.size = parse_size(optarg);
-			break;
-		case 'r':
-			cfg.runtime = atoi(optarg);
-			break;
-		case 'd':
-			cfg.iodepth = atoi(optarg);
-			break;
-		case 'b':
-			cfg.block_size = parse_size(optarg);
-			break;
-		case 'm':
-			if (strcmp(optarg, "direct") == 0)
-			{
-				cfg.passthrough = false;
-			}
-			else if (strcmp(optarg, "passthrough") == 0)
-			{
-				cfg.passthrough = true;
-			}
-			else
-			{
-				std::cerr << "Invalid mode: " << optarg << std::endl;
-				usage(argv[0]);
-			}
-			break;
-		case 'u':
-			if (strcmp(optarg, "submit_and_wait") == 0)
-			{
-				cfg.submit_mode = SubmitMode::SUBMIT_AND_WAIT;
-			}
-			else if (strcmp(optarg, "submit") == 0)
-			{
-				cfg.submit_mode = SubmitMode::SUBMIT;
-			}
-			else if (strcmp(optarg, "sqpoll") == 0)
-			{
-				cfg.submit_mode = SubmitMode::SQPOLL;
-			}
-			else
-			{
-				std::cerr << "Invalid submit mode: " << optarg << std::endl;
-				usage(argv[0]);
-			}
-			break;
-		case 'p':
-			cfg.iopoll = true;
-			break;
-		default:
-			usage(argv[0]);
+			cached_k = crc32c_shift_constant(stride);
+			cached_stride = stride;
+		}
+		uint64_t c0 = crc, c1 = 0, c2 = 0;
+		const uint8_t *p1 = p + stride;
+		const uint8_t *p2 = p + 2 * stride;
+		for (size_t i = 0; i < stride; i += 8)
+		{
+			uint64_t w0, w1, w2;
+			memcpy(&w0, p + i, 8);
+			memcpy(&w1, p1 + i, 8);
+			memcpy(&w2, p2 + i, 8);
+			c0 = _mm_crc32_u64(c0, w0);
+			c1 = _mm_crc32_u64(c1, w1);
+			c2 = _mm_crc32_u64(c2, w2);
 		}
+		crc = crc32c_shift((uint32_t)c0, cached_k) ^ (uint32_t)c1;
+		crc = crc32c_shift(crc, cached_k) ^ (uint32_t)c2;
+		p += 3 * stride;
+		len -= 3 * stride;
 	}
 
-	if (!cfg.filename || !cfg.type || cfg.iodepth == 0 || cfg.block_size == 0)
+	uint64_t c = crc;
+	for (; len >= 8; len -= 8, p += 8)
 	{
-		std::cerr << "Error: Required parameters missing\n";
-		usage(argv[0]);
+		uint64_t w;
+		memcpy(&w, p, 8);
+		c = _mm_crc32_u64(c, w);
 	}
-
-	if (cfg.size == 0 && cfg.runtime == 0)
+	crc = (uint32_t)c;
+	for (; len > 0; len--)
 	{
-		std::cerr << "Error: Either --size or --runtime is required\n";
-		usage(argv[0]);
+		crc = _mm_crc32_u8(crc, *p++);
 	}
+	return crc;
+}
+
+#endif
 
-	if (strcmp(cfg.type, "randread") != 0 && strcmp(cfg.type, "randwrite") != 0)
+static uint32_t (*crc32c_impl)(uint32_t, const uint8_t *, size_t) = crc32c_sw;
+
+static void crc32c_init()
+{
+	crc32c_init_table();
+#if defined(__x86_64__)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("pclmul"))
 	{
-		std::cerr << "Error: Only 'randread' and 'randwrite' types are supported\n";
-		exit(1);
+		crc32c_impl = crc32c_hw;
 	}
+#endif
+}
 
-	return cfg;
+static inline uint32_t crc32c(const void *data, size_t len)
+{
+	return ~crc32c_impl(~0U, (const uint8_t *)data, len);
 }
 
-static void setup_io_uring(struct io_uring *ring, int queue_depth, bool passthrough, SubmitMode submit_mode,
-                           bool iopoll)
+// Every LBA-sized sector written in verify mode starts with this header. The CRC covers everything after the crc
+// field (rest of the header plus payload), so the payload can be any content and is never regenerated per I/O.
+constexpr uint32_t VERIFY_MAGIC = 0x52494f56; // 'RIOV'
+
+struct VerifyHeader
 {
-	struct io_uring_params params = {};
-	if (passthrough)
+	uint32_t magic;
+	uint32_t crc;
+	uint64_t lba;
+	uint64_t generation;
+	uint64_t seed;
+};
+
+struct VerifyStats
+{
+	uint64_t sectors = 0;    // sectors checked
+	uint64_t unwritten = 0;  // no header: never written in verify mode
+	uint64_t bad_crc = 0;    // header present but contents corrupted
+	uint64_t wrong_lba = 0;  // intact block belonging to another LBA (misdirected read/write)
+	uint64_t wrong_seed = 0; // intact block written with a different --verify_seed
+	uint64_t stale = 0;      // intact block from an older write to this LBA
+	uint64_t reported = 0;   // mismatch lines printed so far
+
+	void merge(const VerifyStats &other)
 	{
-		params.flags = IORING_SETUP_SQE128 | IORING_SETUP_CQE32;
+		sectors += other.sectors;
+		unwritten += other.unwritten;
+		bad_crc += other.bad_crc;
+		wrong_lba += other.wrong_lba;
+		wrong_seed += other.wrong_seed;
+		stale += other.stale;
+		reported += other.reported;
 	}
-	if (iopoll)
+};
+
+constexpr uint64_t VERIFY_MAX_REPORTED = 100;
+
+// Fill a buffer with a seed-derived pseudo-random payload (done once per buffer, not per I/O)
+static void fill_verify_pattern(void *buf, size_t len, uint64_t seed)
+{
+	uint64_t state = seed * 0x9E3779B97F4A7C15ULL + 1;
+	uint64_t *words = (uint64_t *)buf;
+	for (size_t i = 0; i < len / sizeof(uint64_t); i++)
 	{
-		params.flags |= IORING_SETUP_IOPOLL;
+		state ^= state << 13;
+		state ^= state >> 7;
+		state ^= state << 17;
+		words[i] = state;
 	}
-	if (submit_mode == SubmitMode::SQPOLL)
+}
+
+// Stamp each sector of a write buffer with its LBA, the write generation and the seed
+static void stamp_verify_headers(void *buf, uint64_t lba, uint64_t nsectors, uint32_t lba_size, uint64_t generation,
+                                 uint64_t seed)
+{
+	uint8_t *sector = (uint8_t *)buf;
+	for (uint64_t i = 0; i < nsectors; i++, sector += lba_size)
 	{
-		params.flags |= IORING_SETUP_SQPOLL | IORING_SETUP_SINGLE_ISSUER;
-		params.sq_thread_idle = 2000; // ms before kernel thread goes idle
+		VerifyHeader *hdr = (VerifyHeader *)sector;
+		hdr->magic = VERIFY_MAGIC;
+		hdr->lba = lba + i;
+		hdr->generation = generation;
+		hdr->seed = seed;
+		hdr->crc = crc32c(sector + 8, lba_size - 8);
 	}
-	else if (!iopoll)
+}
+
+static void report_verify_mismatch(VerifyStats *stats, uint64_t lba, const char *what, uint64_t expected,
+                                   uint64_t found)
+{
+	if (stats->reported++ < VERIFY_MAX_REPORTED)
 	{
-		// Defer completion work to io_uring_enter() for better batching
-		// Note: DEFER_TASKRUN is incompatible with IOPOLL
-		params.flags |= IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN;
+		std::cerr << "Verify: LBA " << lba << ": " << what << " (expected " << expected << ", found " << found << ")"
+		          << std::endl;
 	}
-	else
+}
+
+// Check every sector of a completed read. expected_generation == 0 accepts any generation (inline read checks, where
+// the last writer is unknown); the post-write verify pass passes the exact generation it wrote.
+static void check_verify_headers(const void *buf, uint64_t lba, uint64_t nsectors, uint32_t lba_size, uint64_t seed,
+                                 uint64_t expected_generation, VerifyStats *stats)
+{
+	const uint8_t *sector = (const uint8_t *)buf;
+	for (uint64_t i = 0; i < nsectors; i++, sector += lba_size)
 	{
-		params.flags |= IORING_SETUP_SINGLE_ISSUER;
+		const VerifyHeader *hdr = (const VerifyHeader *)sector;
+		uint64_t cur = lba + i;
+		stats->sectors++;
+
+		if (hdr->magic != VERIFY_MAGIC)
+		{
+			stats->unwritten++;
+			if (expected_generation != 0)
+				report_verify_mismatch(stats, cur, "missing header", VERIFY_MAGIC, hdr->magic);
+			continue;
+		}
+		uint32_t crc = crc32c(sector + 8, lba_size - 8);
+		if (crc != hdr->crc)
+		{
+			stats->bad_crc++;
+			report_verify_mismatch(stats, cur, "crc mismatch", hdr->crc, crc);
+		}
+		else if (hdr->lba != cur)
+		{
+			stats->wrong_lba++;
+			report_verify_mismatch(stats, cur, "block belongs to another LBA", cur, hdr->lba);
+		}
+		else if (hdr->seed != seed)
+		{
+			stats->wrong_seed++;
+			report_verify_mismatch(stats, cur, "seed mismatch", seed, hdr->seed);
+		}
+		else if (expected_generation != 0 && hdr->generation != expected_generation)
+		{
+			stats->stale++;
+			report_verify_mismatch(stats, cur, "stale generation", expected_generation, hdr->generation);
+		}
 	}
-	int ret = io_uring_queue_init_params(queue_depth, ring, &params);
-	if (ret < 0)
+}
+
+static uint64_t verify_failures(const VerifyStats &stats, bool count_unwritten)
+{
+	return stats.bad_crc + stats.wrong_lba + stats.wrong_seed + stats.stale + (count_unwritten ? stats.unwritten : 0);
+}
+
+static void print_verify_stats(const char *title, const VerifyStats &stats)
+{
+	std::cout << "\n";
+	std::cout << title << ":\n";
+	std::cout << "  sectors:    " << stats.sectors << "\n";
+	std::cout << "  unwritten:  " << stats.unwritten << "\n";
+	std::cout << "  bad crc:    " << stats.bad_crc << "\n";
+	std::cout << "  wrong lba:  " << stats.wrong_lba << "\n";
+	std::cout << "  wrong seed: " << stats.wrong_seed << "\n";
+	std::cout << "  stale:      " << stats.stale << "\n";
+	if (stats.reported > VERIFY_MAX_REPORTED)
 	{
-		fatal_error("io_uring_queue_init failed", ret);
+		std::cout << "  (" << stats.reported - VERIFY_MAX_REPORTED << " further mismatches not listed)\n";
 	}
 }
 
-static std::string block_to_char_device(const char *path)
+struct WrittenBlock
 {
-	namespace fs = std::filesystem;
-	fs::path p = path;
+	uint64_t lba;
+	uint64_t generation;
+};
 
-	// Follow symlinks to get the actual device path
-	std::error_code ec;
-	while (fs::is_symlink(p, ec))
+// Error accounting for --continue_on_error. Only touched on the error path, so maps and the per-second series may
+// allocate freely.
+struct ErrorStats
+{
+	uint64_t errors = 0;                         // failed attempts, including ones later retried
+	uint64_t retried = 0;                        // resubmissions issued
+	uint64_t failed = 0;                         // I/Os given up on after all retries
+	std::map<int, uint64_t> by_errno;            // kernel errors (direct mode, or passthrough submission errors)
+	std::map<uint16_t, uint64_t> by_nvme_status; // (SCT << 8 | SC) from passthrough completions
+	std::vector<uint32_t> per_second;            // errors per second since the start of the run
+	uint64_t reported = 0;                       // error lines printed so far
+
+	void merge(const ErrorStats &other)
 	{
-		fs::path target = fs::read_symlink(p, ec);
-		if (ec)
+		errors += other.errors;
+		retried += other.retried;
+		failed += other.failed;
+		for (const auto &[err, count] : other.by_errno)
 		{
-			std::cerr << "Warning: Failed to resolve symlink " << p << ": " << ec.message() << std::endl;
-			break;
+			by_errno[err] += count;
 		}
-		// Handle relative symlinks
-		if (target.is_relative())
+		for (const auto &[code, count] : other.by_nvme_status)
 		{
-			p = p.parent_path() / target;
+			by_nvme_status[code] += count;
 		}
-		else
+		if (per_second.size() < other.per_second.size())
 		{
-			p = target;
+			per_second.resize(other.per_second.size(), 0);
+		}
+		for (size_t sec = 0; sec < other.per_second.size(); sec++)
+		{
+			per_second[sec] += other.per_second[sec];
 		}
+		reported += other.reported;
 	}
+};
 
-	std::string resolved = p.string();
+constexpr uint64_t ERROR_MAX_REPORTED = 100;
 
-	// Validate it's an NVMe device
-	bool has_nvme = resolved.find("nvme") != std::string::npos;
-	bool has_ng = resolved.find("ng") != std::string::npos;
+// Completion status of an I/O: 0 on success, -errno from the kernel, or for passthrough the positive NVMe status
+// field (SC in bits 7:0, SCT in bits 10:8, More/DNR above)
+static inline int io_status(const struct io_uring_cqe *cqe, bool passthrough)
+{
+	if (cqe->res < 0 || passthrough)
+		return cqe->res;
+	return 0;
+}
 
-	if (!has_nvme && !has_ng)
+static inline uint16_t nvme_status_code(int status)
+{
+	return status & 0x7ff;
+}
+
+static const char *nvme_status_name(uint16_t code)
+{
+	switch (code)
 	{
-		std::cerr << "Warning: Device path '" << resolved << "' doesn't appear to be an NVMe device" << std::endl;
-		return resolved;
+	case 0x004:
+		return "Data Transfer Error";
+	case 0x006:
+		return "Internal Error";
+	case 0x007:
+		return "Command Abort Requested";
+	case 0x008:
+		return "Command Aborted due to SQ Deletion";
+	case 0x00b:
+		return "Invalid Namespace or Format";
+	case 0x080:
+		return "LBA Out of Range";
+	case 0x081:
+		return "Capacity Exceeded";
+	case 0x082:
+		return "Namespace Not Ready";
+	case 0x280:
+		return "Write Fault";
+	case 0x281:
+		return "Unrecovered Read Error";
+	case 0x282:
+		return "End-to-end Guard Check Error";
+	case 0x283:
+		return "End-to-end Application Tag Check Error";
+	case 0x284:
+		return "End-to-end Reference Tag Check Error";
+	case 0x285:
+		return "Compare Failure";
+	case 0x286:
+		return "Access Denied";
+	case 0x287:
+		return "Deallocated or Unwritten Logical Block";
+	default:
+		return "Unknown";
 	}
+}
 
-	// If already a character device (ng), return as-is
-	if (has_ng && !has_nvme)
+static std::string describe_io_status(int status)
+{
+	char buf[128];
+	if (status < 0)
 	{
-		return resolved;
+		snprintf(buf, sizeof(buf), "%s", strerror(-status));
+	}
+	else
+	{
+		uint16_t code = nvme_status_code(status);
+		snprintf(buf, sizeof(buf), "NVMe status 0x%03x (%s)%s", code, nvme_status_name(code),
+		         status & 0x4000 ? " DNR" : "");
 	}
+	return buf;
+}
 
-	// Convert nvme -> ng for character device
-	size_t pos = resolved.find("nvme");
-	if (pos != std::string::npos)
+static void record_io_error(ErrorStats *stats, const struct io_uring_cqe *cqe, int status, bool passthrough,
+                            bool is_write, uint64_t lba, double elapsed_sec)
+{
+	stats->errors++;
+	if (status < 0)
+		stats->by_errno[-status]++;
+	else
+		stats->by_nvme_status[nvme_status_code(status)]++;
+
+	size_t second = (size_t)elapsed_sec;
+	if (stats->per_second.size() <= second)
 	{
-		resolved.replace(pos, 4, "ng");
+		stats->per_second.resize(second + 1, 0);
 	}
+	stats->per_second[second]++;
 
-	return resolved;
+	if (stats->reported++ < ERROR_MAX_REPORTED)
+	{
+		// Formatted locally so the stream flags do not stick to std::cerr
+		std::ostringstream line;
+		line << "Error: t=" << std::fixed << std::setprecision(3) << elapsed_sec << "s "
+		     << (is_write ? "write" : "read") << " LBA " << lba << ": " << describe_io_status(status);
+		if (passthrough)
+		{
+			// CQE32: the second half carries the command's completion dword 0
+			line << " (result 0x" << std::hex << cqe->big_cqe[0] << ")";
+		}
+		std::cerr << line.str() << std::endl;
+	}
 }
 
-static void open_nvme_ssd(const char *path, bool passthrough, NVMeDevice *nvme)
+static void print_error_stats(const ErrorStats &stats)
 {
-	std::string device_path = path;
-	int flags = O_RDWR;
-	if (passthrough)
+	std::cout << "\n";
+	std::cout << "Errors:\n";
+	std::cout << "  errors:     " << stats.errors << "\n";
+	std::cout << "  retried:    " << stats.retried << "\n";
+	std::cout << "  failed:     " << stats.failed << "\n";
+	for (const auto &[err, count] : stats.by_errno)
 	{
-		device_path = block_to_char_device(path);
+		std::cout << "    errno " << err << " (" << strerror(err) << "): " << count << "\n";
 	}
-	else
+	for (const auto &[code, count] : stats.by_nvme_status)
 	{
-		flags |= O_DIRECT;
+		char buf[16];
+		snprintf(buf, sizeof(buf), "0x%03x", code);
+		std::cout << "    nvme " << buf << " (" << nvme_status_name(code) << "): " << count << "\n";
 	}
-	nvme->fd = open(device_path.c_str(), flags);
-	if (nvme->fd < 0)
+	if (stats.errors > 0)
 	{
-		fatal_error("Failed to open device");
+		std::cout << "  Errors per second:\n";
+		for (size_t sec = 0; sec < stats.per_second.size(); sec++)
+		{
+			if (stats.per_second[sec] > 0)
+				std::cout << "    " << std::setw(6) << sec << "s: " << stats.per_second[sec] << "\n";
+		}
 	}
+}
 
-	if (passthrough)
+// Hung-command detection for --io_timeout. In-flight slots are swept periodically instead of arming a linked timeout
+// per I/O, so the submit/complete path is unchanged until a command actually exceeds the timeout. Overdue commands
+// are logged and get a best-effort async cancel; the kernel cannot cancel requests already issued to the device.
+constexpr uint64_t CANCEL_USER_DATA = UINT64_MAX;
+
+struct TimeoutStats
+{
+	uint64_t timed_out = 0;     // I/Os seen exceeding --io_timeout
+	uint64_t cancelled = 0;     // of those, completed as cancelled
+	uint64_t late = 0;          // of those, eventually completed by the device
+	uint64_t cancel_failed = 0; // cancel requests the kernel could not honour
+	uint64_t reported = 0;      // timeout lines printed so far
+
+	void merge(const TimeoutStats &other)
 	{
-		// Query namespace ID
-		if (ioctl(nvme->fd, NVME_IOCTL_ID, &nvme->nsid) < 0) // io control operation
+		timed_out += other.timed_out;
+		cancelled += other.cancelled;
+		late += other.late;
+		cancel_failed += other.cancel_failed;
+		reported += other.reported;
+	}
+};
+
+static void sweep_timeouts(struct io_uring *ring, IOContext *io_contexts, int iodepth, bool is_write, TimePoint now,
+                           TimePoint start_time, std::chrono::milliseconds timeout, TimeoutStats *stats)
+{
+	for (int i = 0; i < iodepth; i++)
+	{
+		IOContext *ctx = &io_contexts[i];
+		if (ctx->timed_out || ctx->submit_time == TimePoint::max() || now - ctx->submit_time < timeout)
+			continue;
+
+		struct io_uring_sqe *sqe = io_uring_get_sqe(ring);
+		if (!sqe)
+			return; // SQ full; retry on the next sweep
+
+		io_uring_prep_cancel64(sqe, (uint64_t)i, 0);
+		io_uring_sqe_set_data64(sqe, CANCEL_USER_DATA);
+		ctx->timed_out = true;
+		stats->timed_out++;
+
+		if (stats->reported++ < ERROR_MAX_REPORTED)
 		{
-			close(nvme->fd);
-			fatal_error("Failed to get namespace ID");
+			double age_ms = std::chrono::duration<double, std::milli>(now - ctx->submit_time).count();
+			double at_sec = std::chrono::duration<double>(now - start_time).count();
+			std::ostringstream line; // keeps the stream flags off std::cerr
+			line << "Timeout: t=" << std::fixed << std::setprecision(3) << at_sec << "s "
+			     << (is_write ? "write" : "read") << " LBA " << ctx->lba << " outstanding for " << std::setprecision(1)
+			     << age_ms << " ms";
+			std::cerr << line.str() << std::endl;
 		}
+	}
+}
 
-		// Get namespace info using Identify Namespace command
-		char identify_data[4096];
-		memset(identify_data, 0, sizeof(identify_data));
-		struct nvme_passthru_cmd cmd = {
-		    .opcode = nvme_admin_identify,           // eg identify, read, write
-		    .nsid = nvme->nsid,                      // namespace id
-		    .addr = (uint64_t)identify_data,         // user-space address for data buffer
-		    .data_len = 4096,                        // data buffer length
-		    .cdw10 = NVME_IDENTIFY_CNS_NS,           // data structure being requested
-		    .cdw11 = (uint32_t)NVME_CSI_NVM << 24,   // logical blocks store (vs key value store vs zones store)
-		    .timeout_ms = NVME_DEFAULT_IOCTL_TIMEOUT // default timeout
-		};
+static void print_timeout_stats(const TimeoutStats &stats)
+{
+	std::cout << "\n";
+	std::cout << "Timeouts:\n";
+	std::cout << "  timed out:  " << stats.timed_out << "\n";
+	std::cout << "  cancelled:  " << stats.cancelled << "\n";
+	std::cout << "  late:       " << stats.late << "\n";
+	std::cout << "  cancel err: " << stats.cancel_failed << "\n";
+}
 
-		if (ioctl(nvme->fd, NVME_IOCTL_ADMIN_CMD, &cmd) < 0)
+// Append-only per-worker record: latency samples, written blocks, recorded offsets. Address space for the most
+// entries a phase can produce is reserved up front and made writable a window at a time, so appending never
+// reallocates or copies. While a phase runs, the log committer thread keeps each worker's logs writable well ahead
+// of the worker, so the I/O path does not make the mprotect call either (under --rt it also faults in and locks the
+// window); the worker only commits inline if the committer falls behind.
+constexpr size_t APPEND_LOG_WINDOW = 2 << 20;                // bytes committed at a time
+constexpr size_t APPEND_LOG_AHEAD = 4 * APPEND_LOG_WINDOW;   // kept writable beyond the writer by the committer
+constexpr uint64_t APPEND_LOG_MAX_RATE = 16000000;           // completions per second, more than one worker can reach
+
+struct AppendLogSpace
+{
+	static inline std::mutex commit_mutex; // serializes commits by the writer and by the committer
+
+	char *base = nullptr;
+	size_t reserved = 0;           // bytes mapped
+	size_t writable = 0;           // bytes committed, under commit_mutex
+	std::atomic<size_t> limit {0}; // writable, for the writer to check without the lock
+	std::atomic<size_t> used {0};  // bytes appended, for the committer
+
+	// Make the first `bytes` writable; false if that is past the reservation. The caller holds commit_mutex.
+	bool commit(size_t bytes)
+	{
+		if (bytes <= writable)
 		{
-			close(nvme->fd);
-			fatal_error("Failed to identify namespace");
+			return true;
 		}
-		struct nvme_id_ns *ns = (struct nvme_id_ns *)identify_data;
-		int lba_format_index = ns->flbas & 0x0F;
-		int lbads = ns->lbaf[lba_format_index].ds; // get 'data size' of LBA format entry
+		if (bytes > reserved)
+		{
+			return false;
+		}
+		size_t target = std::min((bytes + APPEND_LOG_WINDOW - 1) / APPEND_LOG_WINDOW * APPEND_LOG_WINDOW, reserved);
+		if (mprotect(base + writable, target - writable, PROT_READ | PROT_WRITE) < 0)
+		{
+			fatal_error("Failed to commit a per-worker log", -errno);
+		}
+		writable = target;
+		limit.store(writable, std::memory_order_release);
+		return true;
+	}
 
-		nvme->lba_size = 1 << lbads; // eg ds=9, lba_size = 2^9 = 512 bytes
-		nvme->nlba = ns->nsze;
+	void commit_ahead()
+	{
+		commit(std::min(used.load(std::memory_order_relaxed) + APPEND_LOG_AHEAD, reserved));
 	}
-	else
+};
+
+template <typename T>
+struct AppendLog
+{
+	static_assert(std::is_trivially_copyable_v<T>, "log entries are not constructed or destroyed");
+
+	AppendLogSpace space;
+	size_t count = 0;
+	uint64_t dropped = 0; // appends past the reservation
+
+	AppendLog() = default;
+	AppendLog(const AppendLog &) = delete;
+	AppendLog(AppendLog &&other) noexcept
 	{
-		// Direct mode: use standard block device ioctls
-		uint64_t size_bytes;
-		if (ioctl(nvme->fd, BLKGETSIZE64, &size_bytes) < 0)
+		*this = std::move(other);
+	}
+	// Only while no committer watches either log
+	AppendLog &operator=(AppendLog &&other) noexcept
+	{
+		std::swap(space.base, other.space.base);
+		std::swap(space.reserved, other.space.reserved);
+		std::swap(space.writable, other.space.writable);
+		space.limit.store(space.writable, std::memory_order_relaxed);
+		other.space.limit.store(other.space.writable, std::memory_order_relaxed);
+		std::swap(count, other.count);
+		space.used.store(count * sizeof(T), std::memory_order_relaxed);
+		other.space.used.store(other.count * sizeof(T), std::memory_order_relaxed);
+		std::swap(dropped, other.dropped);
+		return *this;
+	}
+	~AppendLog()
+	{
+		if (space.base)
 		{
-			close(nvme->fd);
-			fatal_error("Failed to get device size");
+			munmap(space.base, space.reserved);
 		}
+	}
 
-		int logical_block_size;
-		if (ioctl(nvme->fd, BLKSSZGET, &logical_block_size) < 0)
+	// Drop the contents and make room for `entries`, capped at physical memory
+	void reserve(size_t entries)
+	{
+		*this = AppendLog {};
+		static const size_t memory = (size_t)sysconf(_SC_PHYS_PAGES) * (size_t)sysconf(_SC_PAGESIZE);
+		size_t bytes = std::min(entries, memory / sizeof(T)) * sizeof(T);
+		bytes = (bytes + APPEND_LOG_WINDOW - 1) / APPEND_LOG_WINDOW * APPEND_LOG_WINDOW;
+		if (bytes == 0)
 		{
-			close(nvme->fd);
-			fatal_error("Failed to get logical block size");
+			return;
+		}
+		void *p = mmap(nullptr, bytes, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		if (p == MAP_FAILED)
+		{
+			fatal_error("Failed to reserve a per-worker log", -errno);
 		}
+		space.base = (char *)p;
+		space.reserved = bytes;
+	}
 
-		nvme->lba_size = logical_block_size;
-		nvme->nlba = size_bytes / nvme->lba_size;
-		nvme->nsid = 0; // N/A
+	// Room for n more entries, or nullptr once the reservation is used up
+	T *extend(size_t n)
+	{
+		size_t end = (count + n) * sizeof(T);
+		if (end > space.limit.load(std::memory_order_acquire))
+		{
+			std::lock_guard<std::mutex> lock(AppendLogSpace::commit_mutex);
+			if (!space.commit(end))
+			{
+				dropped += n;
+				return nullptr;
+			}
+		}
+		T *out = begin() + count;
+		count += n;
+		space.used.store(end, std::memory_order_relaxed);
+		return out;
 	}
-}
 
-static void *alloc_aligned_buffer(size_t size, size_t alignment)
-{
-	void *buf;
-	if (posix_memalign(&buf, alignment, size) != 0)
+	void push_back(const T &value)
 	{
-		fatal_error("Failed to allocate aligned buffer");
+		size_t end = (count + 1) * sizeof(T);
+		if (end <= space.limit.load(std::memory_order_acquire)) [[likely]]
+		{
+			begin()[count++] = value;
+			space.used.store(end, std::memory_order_relaxed);
+		}
+		else if (T *slot = extend(1))
+		{
+			*slot = value;
+		}
 	}
-	return buf;
-}
 
-static uint64_t random_lba(uint64_t max_lba, uint64_t block_lbas)
-{
-	static thread_local std::mt19937_64 rng(std::random_device {}());
+	void truncate(size_t n)
+	{
+		count = std::min(count, n);
+	}
 
-	if (max_lba <= block_lbas)
+	const T &operator[](size_t i) const
 	{
-		return 0;
+		return begin()[i];
 	}
-	uint64_t max_start = max_lba - block_lbas;
-	std::uniform_int_distribution<uint64_t> dist(0, max_start);
-	return dist(rng);
-}
+	T *begin()
+	{
+		return (T *)space.base;
+	}
+	T *end()
+	{
+		return begin() + count;
+	}
+	const T *begin() const
+	{
+		return (const T *)space.base;
+	}
+	const T *end() const
+	{
+		return begin() + count;
+	}
+	size_t size() const
+	{
+		return count;
+	}
+	bool empty() const
+	{
+		return count == 0;
+	}
+};
 
-static void submit_read_direct(struct io_uring *ring, int fixed_fd_idx, void *buf, size_t size, uint64_t offset,
-                               int buf_index)
+// Keeps the logs of running workers committed ahead of them. Workers add their logs once they are reserved and
+// remove them before the logs are moved, reset or freed.
+struct LogCommitter
 {
-	struct io_uring_sqe *sqe = io_uring_get_sqe(ring);
-	if (!sqe)
+	std::mutex mutex; // guards logs
+	std::vector<AppendLogSpace *> logs;
+	std::atomic<bool> stop {false};
+	std::thread thread;
+
+	// Commits the first stretch right away, before the worker starts timing I/O
+	void watch(AppendLogSpace *log)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		{
+			std::lock_guard<std::mutex> commit_lock(AppendLogSpace::commit_mutex);
+			log->commit_ahead();
+		}
+		logs.push_back(log);
+	}
+
+	void unwatch(AppendLogSpace *log)
 	{
-		fatal_error("Failed to get SQE");
+		std::lock_guard<std::mutex> lock(mutex);
+		logs.erase(std::find(logs.begin(), logs.end(), log));
 	}
-	io_uring_prep_read_fixed(sqe, fixed_fd_idx, buf, size, offset, buf_index);
-	sqe->flags |= IOSQE_FIXED_FILE;
-	io_uring_sqe_set_data(sqe, (void *)(uintptr_t)buf_index);
-}
+};
 
-static void submit_write_direct(struct io_uring *ring, int fixed_fd_idx, void *buf, size_t size, uint64_t offset,
-                                int buf_index)
+static void log_committer_loop(LogCommitter *lc)
 {
-	struct io_uring_sqe *sqe = io_uring_get_sqe(ring);
-	if (!sqe)
+	while (!lc->stop.load(std::memory_order_acquire))
 	{
-		fatal_error("Failed to get SQE");
+		{
+			std::lock_guard<std::mutex> lock(lc->mutex);
+			for (AppendLogSpace *log : lc->logs)
+			{
+				std::lock_guard<std::mutex> commit_lock(AppendLogSpace::commit_mutex);
+				log->commit_ahead();
+			}
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
 	}
-	io_uring_prep_write_fixed(sqe, fixed_fd_idx, buf, size, offset, buf_index);
-	sqe->flags |= IOSQE_FIXED_FILE;
-	io_uring_sqe_set_data(sqe, (void *)(uintptr_t)buf_index);
 }
 
-static double percentile(std::vector<double> &sorted_latencies, double p)
+// Slow-I/O capture: a bounded min-heap keeps the N slowest I/Os and an optional log keeps every I/O above a
+// threshold. Fast I/Os cost one comparison against the heap minimum; nothing is stored per I/O otherwise.
+struct SlowIO
 {
-	if (sorted_latencies.empty())
-		return 0.0;
-	double index = (p / 100.0) * (sorted_latencies.size() - 1);
-	size_t lower = (size_t)index;
-	size_t upper = lower + 1;
-	if (upper >= sorted_latencies.size())
-		return sorted_latencies.back();
-	double frac = index - lower;
-	return sorted_latencies[lower] * (1 - frac) + sorted_latencies[upper] * frac;
-}
+	uint64_t latency_ns;
+	uint64_t submit_ns; // relative to the start of the run
+	uint64_t lba;
+	uint32_t size;
+	int queue_depth;
+	bool is_write;
+};
 
-static void print_metrics(const std::vector<double> &latencies, double elapsed_sec, uint64_t completed_ops,
-                          size_t block_size)
+struct SlowIOTracker
 {
-	double iops = completed_ops / elapsed_sec;
-	double bandwidth_mbs = (completed_ops * block_size) / (elapsed_sec * 1024 * 1024);
+	size_t top_n = 0;
+	uint64_t threshold_ns = 0;
+	std::vector<SlowIO> heap; // min-heap on latency
+	AppendLog<SlowIO> log;    // completion order
 
-	// Calculate latency statistics
-	std::vector<double> sorted_lat = latencies;
-	std::sort(sorted_lat.begin(), sorted_lat.end());
+	bool enabled() const
+	{
+		return top_n > 0 || threshold_ns > 0;
+	}
 
-	double avg_lat = 0.0;
-	if (!latencies.empty())
+	bool wants(uint64_t latency_ns) const
+	{
+		return (top_n > 0 && (heap.size() < top_n || latency_ns > heap.front().latency_ns)) ||
+		       (threshold_ns > 0 && latency_ns >= threshold_ns);
+	}
+
+	void push_top(const SlowIO &io)
+	{
+		auto slower = [](const SlowIO &a, const SlowIO &b) { return a.latency_ns > b.latency_ns; };
+		if (heap.size() == top_n)
+		{
+			std::pop_heap(heap.begin(), heap.end(), slower);
+			heap.pop_back();
+		}
+		heap.push_back(io);
+		std::push_heap(heap.begin(), heap.end(), slower);
+	}
+
+	void record(const SlowIO &io)
 	{
-		avg_lat = std::accumulate(latencies.begin(), latencies.end(), 0.0) / latencies.size();
+		if (top_n > 0 && (heap.size() < top_n || io.latency_ns > heap.front().latency_ns))
+		{
+			push_top(io);
+		}
+		if (threshold_ns > 0 && io.latency_ns >= threshold_ns)
+		{
+			log.push_back(io);
+		}
 	}
 
-	double p50 = percentile(sorted_lat, 50.0);
-	double p95 = percentile(sorted_lat, 95.0);
-	double p99 = percentile(sorted_lat, 99.0);
-	double min_lat = sorted_lat.empty() ? 0.0 : sorted_lat.front();
-	double max_lat = sorted_lat.empty() ? 0.0 : sorted_lat.back();
+	void merge(const SlowIOTracker &other)
+	{
+		for (const SlowIO &io : other.heap)
+		{
+			if (heap.size() < top_n || io.latency_ns > heap.front().latency_ns)
+				push_top(io);
+		}
+		if (SlowIO *out = log.extend(other.log.size()))
+		{
+			std::copy(other.log.begin(), other.log.end(), out);
+		}
+	}
+};
 
+template <typename SlowIOs>
+static void print_slow_ios(const char *title, const SlowIOs &ios)
+{
 	std::cout << "\n";
-	std::cout << "Results:\n";
-	std::cout << "  IOPS:       " << std::fixed << std::setprecision(0) << iops << "\n";
-	std::cout << "  Bandwidth:  " << std::fixed << std::setprecision(2) << bandwidth_mbs << " MB/s\n";
-	std::cout << "  Latency (us):\n";
-	std::cout << "    avg:      " << std::fixed << std::setprecision(2) << avg_lat << "\n";
-	std::cout << "    min:      " << std::fixed << std::setprecision(2) << min_lat << "\n";
-	std::cout << "    p50:      " << std::fixed << std::setprecision(2) << p50 << "\n";
-	std::cout << "    p95:      " << std::fixed << std::setprecision(2) << p95 << "\n";
-	std::cout << "    p99:      " << std::fixed << std::setprecision(2) << p99 << "\n";
-	std::cout << "    max:      " << std::fixed << std::setprecision(2) << max_lat << "\n";
+	std::cout << title << ":\n";
+	std::cout << "    submit(ms)  latency(us)  op     " << std::setw(14) << "lba"
+	          << "  " << std::setw(8) << "size"
+	          << "  qd\n";
+	for (const SlowIO &io : ios)
+	{
+		std::cout << "  " << std::fixed << std::setprecision(3) << std::setw(12) << io.submit_ns / 1e6 << " "
+		          << std::setprecision(2) << std::setw(12) << io.latency_ns / 1e3 << "  "
+		          << (io.is_write ? "write  " : "read   ") << std::setw(14) << io.lba << "  " << std::setw(8) << io.size
+		          << "  " << io.queue_depth << "\n";
+	}
 }
 
-static void submit_read_passthrough(struct io_uring *ring, NVMeDevice *nvme, int fixed_fd_idx, void *buf, uint64_t lba,
-                                    uint32_t blocks, int buf_index)
+static void print_slow_io_report(SlowIOTracker *slow)
 {
-	struct io_uring_sqe *sqe = io_uring_get_sqe(ring);
-	if (!sqe)
+	if (slow->top_n > 0)
 	{
-		fatal_error("Failed to get SQE");
+		std::sort(slow->heap.begin(), slow->heap.end(),
+		          [](const SlowIO &a, const SlowIO &b) { return a.latency_ns > b.latency_ns; });
+		print_slow_ios("Slowest I/Os", slow->heap);
 	}
+	if (slow->threshold_ns > 0)
+	{
+		std::sort(slow->log.begin(), slow->log.end(),
+		          [](const SlowIO &a, const SlowIO &b) { return a.submit_ns < b.submit_ns; });
+		std::string title = "I/Os above " + std::to_string(slow->threshold_ns / 1000) + " us (" +
+		                    std::to_string(slow->log.size()) + ")";
+		print_slow_ios(title.c_str(), slow->log);
+	}
+}
 
-	// Prepare NVMe uring command (different from nvme_passthru_cmd)
-	struct nvme_uring_cmd cmd = {};
-	cmd.opcode = nvme_cmd_read;
-	cmd.nsid = nvme->nsid;
-	cmd.addr = (uint64_t)buf;
-	cmd.data_len = blocks * nvme->lba_size;
-	cmd.cdw10 = (uint32_t)lba;         // starting LBA lower 32 bits
-	cmd.cdw11 = (uint32_t)(lba >> 32); // starting LBA upper 32 bits
-	cmd.cdw12 = blocks - 1;            // number of blocks (0-based)
+// Latency heatmaps: latency bucket against LBA region and against time interval. Latency columns are power-of-two
+// buckets from <1us to >=1s; LBA regions are power-of-two sized so the region index is a shift. Each I/O adds one
+// to a cell of each matrix; worker matrices are merged at the end.
+constexpr int HEATMAP_LAT_COLS = 22;
+constexpr int HEATMAP_FIRST_SHIFT = 10; // column 0 is < 2^10 ns
+constexpr size_t HEATMAP_MAX_INTERVALS = 86400; // rows reserved for size-based runs, a day at the default resolution
 
-	// Setup IORING_OP_URING_CMD for NVMe passthrough
-	sqe->opcode = IORING_OP_URING_CMD;
-	sqe->fd = fixed_fd_idx;
-	sqe->cmd_op = NVME_URING_CMD_IO;
-	sqe->flags |= IOSQE_FIXED_FILE;
-	memcpy(sqe->cmd, &cmd, sizeof(cmd));
-	io_uring_sqe_set_data(sqe, (void *)(uintptr_t)buf_index);
+static inline int heatmap_col(uint64_t latency_ns)
+{
+	int msb = latency_ns ? 63 - __builtin_clzll(latency_ns) : 0;
+	return std::clamp(msb - HEATMAP_FIRST_SHIFT + 1, 0, HEATMAP_LAT_COLS - 1);
 }
 
-static void submit_write_passthrough(struct io_uring *ring, NVMeDevice *nvme, int fixed_fd_idx, void *buf, uint64_t lba,
-                                     uint32_t blocks, int buf_index)
+struct Heatmap
 {
-	struct io_uring_sqe *sqe = io_uring_get_sqe(ring);
-	if (!sqe)
+	int region_shift = 0;
+	uint64_t nregions = 0;
+	std::vector<uint64_t> by_region; // nregions rows of HEATMAP_LAT_COLS
+	std::chrono::milliseconds interval {0};
+	TimePoint interval_end;
+	std::vector<std::array<uint64_t, HEATMAP_LAT_COLS>> by_time; // reserved up front, never grown while recording
+	bool time_full = false; // ran past the reserved intervals; later I/Os are only in by_region
+
+	void init(uint64_t nlba, int regions, std::chrono::milliseconds resolution, TimePoint start, size_t intervals)
 	{
-		fatal_error("Failed to get SQE");
+		region_shift = 0;
+		while ((nlba >> region_shift) > (uint64_t)regions)
+		{
+			region_shift++;
+		}
+		nregions = (nlba >> region_shift) + 1;
+		by_region.assign(nregions * HEATMAP_LAT_COLS, 0);
+		interval = resolution;
+		interval_end = start + interval;
+		by_time.reserve(intervals);
+		by_time.push_back({});
 	}
 
-	struct nvme_uring_cmd cmd = {};
-	cmd.opcode = nvme_cmd_write;
-	cmd.nsid = nvme->nsid;
-	cmd.addr = (uint64_t)buf;
-	cmd.data_len = blocks * nvme->lba_size;
-	cmd.cdw10 = (uint32_t)lba;         // starting LBA lower 32 bits
-	cmd.cdw11 = (uint32_t)(lba >> 32); // starting LBA upper 32 bits
-	cmd.cdw12 = blocks - 1;            // number of blocks (0-based)
+	void record(uint64_t lba, uint64_t latency_ns, TimePoint complete_time)
+	{
+		int col = heatmap_col(latency_ns);
+		by_region[(lba >> region_shift) * HEATMAP_LAT_COLS + col]++;
+		while (complete_time >= interval_end && !time_full)
+		{
+			time_full = by_time.size() == by_time.capacity();
+			if (!time_full)
+			{
+				by_time.push_back({});
+				interval_end += interval;
+			}
+		}
+		if (!time_full)
+		{
+			by_time.back()[col]++;
+		}
+	}
 
-	sqe->opcode = IORING_OP_URING_CMD;
-	sqe->fd = fixed_fd_idx;
-	sqe->cmd_op = NVME_URING_CMD_IO;
-	sqe->flags |= IOSQE_FIXED_FILE;
-	memcpy(sqe->cmd, &cmd, sizeof(cmd));
-	io_uring_sqe_set_data(sqe, (void *)(uintptr_t)buf_index);
+	void merge(const Heatmap &other)
+	{
+		for (size_t i = 0; i < by_region.size(); i++)
+		{
+			by_region[i] += other.by_region[i];
+		}
+		time_full |= other.time_full;
+		if (by_time.size() < other.by_time.size())
+		{
+			by_time.resize(other.by_time.size(), {});
+		}
+		for (size_t t = 0; t < other.by_time.size(); t++)
+		{
+			for (int c = 0; c < HEATMAP_LAT_COLS; c++)
+			{
+				by_time[t][c] += other.by_time[t][c];
+			}
+		}
+	}
+};
+
+static void write_heatmap_header(std::ofstream &out, const char *first_columns)
+{
+	out << first_columns;
+	for (int c = 0; c < HEATMAP_LAT_COLS; c++)
+	{
+		double bound_us = (double)(1ULL << (c + HEATMAP_FIRST_SHIFT)) / 1000.0;
+		double lower_us = bound_us / 2;
+		if (c == HEATMAP_LAT_COLS - 1)
+			out << ",ge_" << lower_us << "us";
+		else
+			out << ",lt_" << bound_us << "us";
+	}
+	out << "\n";
 }
 
-int main(int argc, char **argv)
+static void write_heatmaps(const char *prefix, const Heatmap &hm)
 {
-	Config cfg = parse_args(argc, argv);
+	std::string lba_path = std::string(prefix) + "_lba.csv";
+	std::ofstream lba_csv(lba_path);
+	write_heatmap_header(lba_csv, "lba_start,lba_end");
+	for (uint64_t r = 0; r < hm.nregions; r++)
+	{
+		lba_csv << (r << hm.region_shift) << "," << ((r + 1) << hm.region_shift) - 1;
+		for (int c = 0; c < HEATMAP_LAT_COLS; c++)
+		{
+			lba_csv << "," << hm.by_region[r * HEATMAP_LAT_COLS + c];
+		}
+		lba_csv << "\n";
+	}
+
+	std::string time_path = std::string(prefix) + "_time.csv";
+	std::ofstream time_csv(time_path);
+	write_heatmap_header(time_csv, "time_start_s");
+	for (size_t t = 0; t < hm.by_time.size(); t++)
+	{
+		time_csv << t * hm.interval.count() / 1000.0;
+		for (int c = 0; c < HEATMAP_LAT_COLS; c++)
+		{
+			time_csv << "," << hm.by_time[t][c];
+		}
+		time_csv << "\n";
+	}
+
+	if (!lba_csv || !time_csv)
+	{
+		std::cerr << "Warning: Failed to write heatmaps to " << lba_path << " / " << time_path << std::endl;
+		return;
+	}
+	std::cout << "\nHeatmaps written to " << lba_path << " and " << time_path << "\n";
+	if (hm.time_full)
+	{
+		std::cout << "  The time heatmap stops after " << hm.by_time.size() << " intervals\n";
+	}
+}
+
+// Queue occupancy, time-weighted. "Outstanding" counts I/Os issued and not yet reaped, which is what the latency
+// timestamps cover. "At device" leaves out completions already posted to the CQ but not yet reaped, so the gap
+// between the two is reap lag. The loop closes an interval at the two points per iteration where it looks at
+// the ring, not per I/O.
+struct QueueOccupancy
+{
+	std::vector<uint64_t> device_ns; // time spent at each device-side depth
+	double outstanding_sum = 0;      // integral of outstanding I/Os over time, in I/O-ns
+	double device_sum = 0;
+	uint64_t total_ns = 0;
+	TimePoint mark;
+
+	void init(int iodepth, TimePoint now)
+	{
+		device_ns.assign(iodepth + 1, 0);
+		mark = now;
+	}
+
+	// Close the interval since the last mark. The device depth moved from device_from to device_to in it and is
+	// taken to have changed linearly.
+	void account(TimePoint now, int outstanding, int device_from, int device_to)
+	{
+		uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(now - mark).count();
+		mark = now;
+		total_ns += ns;
+		outstanding_sum += (double)outstanding * ns;
+		device_sum += (device_from + device_to) * ns / 2.0;
+		device_ns[device_from] += ns / 2;
+		device_ns[device_to] += ns - ns / 2;
+	}
+
+	void merge(const QueueOccupancy &other)
+	{
+		if (device_ns.size() < other.device_ns.size())
+		{
+			device_ns.resize(other.device_ns.size(), 0);
+		}
+		for (size_t d = 0; d < other.device_ns.size(); d++)
+		{
+			device_ns[d] += other.device_ns[d];
+		}
+		outstanding_sum += other.outstanding_sum;
+		device_sum += other.device_sum;
+		total_ns = std::max(total_ns, other.total_ns);
+	}
+
+	double avg_outstanding() const
+	{
+		return total_ns ? outstanding_sum / total_ns : 0;
+	}
+
+	double avg_device() const
+	{
+		return total_ns ? device_sum / total_ns : 0;
+	}
+
+	// Smallest depth the device was at or below for at least p percent of the time
+	int device_percentile(double p) const
+	{
+		uint64_t sum = 0;
+		for (uint64_t ns : device_ns)
+		{
+			sum += ns;
+		}
+		uint64_t target = (uint64_t)(sum * p / 100.0);
+		uint64_t seen = 0;
+		for (size_t d = 0; d < device_ns.size(); d++)
+		{
+			seen += device_ns[d];
+			if (seen >= target && seen > 0)
+				return (int)d;
+		}
+		return 0;
+	}
+};
+
+// Little's law: with IOPS and mean latency measured independently, IOPS x latency must equal the mean number of
+// outstanding I/Os. Disagreement means the latency timestamps miss part of the time I/Os are held. A device depth
+// well below the outstanding depth means completions are waiting on the tool rather than the device.
+static void print_queue_occupancy(const QueueOccupancy &occ, int iodepth, int workers, bool rate_limited,
+                                  double iops, double avg_latency_us)
+{
+	double outstanding = occ.avg_outstanding();
+	double device = occ.avg_device();
+	double little = iops * avg_latency_us / 1e6;
+	uint64_t dist_ns = std::accumulate(occ.device_ns.begin(), occ.device_ns.end(), (uint64_t)0);
+	double full_pct = dist_ns ? 100.0 * occ.device_ns[iodepth] / dist_ns : 0;
+
+	std::cout << "\n";
+	std::cout << "Queue depth (time-weighted, iodepth " << iodepth;
+	if (workers > 1)
+	{
+		std::cout << " x " << workers << " workers; distribution per worker";
+	}
+	std::cout << "):\n";
+	std::cout << "  outstanding: " << std::fixed << std::setprecision(2) << outstanding << "\n";
+	std::cout << "  at device:   " << std::fixed << std::setprecision(2) << device << " (p10 "
+	          << occ.device_percentile(10) << ", p50 " << occ.device_percentile(50) << ", p90 "
+	          << occ.device_percentile(90) << ", full " << std::setprecision(1) << full_pct << "% of the time)\n";
+	std::cout << "  IOPS x lat:  " << std::fixed << std::setprecision(2) << little << "\n";
+
+	if (outstanding > 0 && std::fabs(little - outstanding) > 0.1 * outstanding)
+	{
+		std::cout << "  Warning: Little's law mismatch; measured latency does not account for the time I/Os were "
+		             "outstanding\n";
+	}
+	if (outstanding > 0 && device < 0.9 * outstanding)
+	{
+		std::cout << "  Warning: completions waited to be reaped for " << std::setprecision(0)
+		          << 100.0 * (1 - device / outstanding)
+		          << "% of the outstanding time; the tool, not the device, limits the effective queue depth\n";
+	}
+	if (!rate_limited && outstanding < 0.9 * iodepth * workers)
+	{
+		std::cout << "  Warning: only " << std::setprecision(2) << outstanding << " of " << iodepth * workers
+		          << " I/Os were kept outstanding on average\n";
+	}
+}
+
+static unsigned parse_continue_on_error(const char *str)
+{
+	unsigned mask = 0;
+	std::string list = str;
+	size_t pos = 0;
+	while (pos <= list.size())
+	{
+		size_t end = list.find(',', pos);
+		std::string item = list.substr(pos, end == std::string::npos ? std::string::npos : end - pos);
+		if (item == "read")
+			mask |= CONTINUE_ON_READ;
+		else if (item == "write")
+			mask |= CONTINUE_ON_WRITE;
+		else if (item == "all")
+			mask |= CONTINUE_ON_READ | CONTINUE_ON_WRITE;
+		else if (item != "none")
+		{
+			std::cerr << "Invalid --continue_on_error value: " << item << std::endl;
+			exit(1);
+		}
+		if (end == std::string::npos)
+			break;
+		pos = end + 1;
+	}
+	return mask;
+}
+
+// --prio: <class>[:<level>] with class rt, be or idle and level 0-7 (default 4, IOPRIO_NORM)
+static uint16_t parse_ioprio(const char *str)
+{
+	std::string spec = str;
+	size_t colon = spec.find(':');
+	std::string cls = spec.substr(0, colon);
+	int level = colon == std::string::npos ? IOPRIO_NORM : atoi(spec.c_str() + colon + 1);
+
+	int ioprio_class;
+	if (cls == "rt")
+		ioprio_class = IOPRIO_CLASS_RT;
+	else if (cls == "be")
+		ioprio_class = IOPRIO_CLASS_BE;
+	else if (cls == "idle")
+		ioprio_class = IOPRIO_CLASS_IDLE;
+	else
+		ioprio_class = -1;
+	if (ioprio_class < 0 || level < 0 || level >= IOPRIO_NR_LEVELS)
+	{
+		std::cerr << "Invalid --prio value: " << str << std::endl;
+		exit(1);
+	}
+	return IOPRIO_PRIO_VALUE(ioprio_class, level);
+}
+
+static std::string describe_ioprio(uint16_t ioprio)
+{
+	static const char *const classes[] = {"none", "rt", "be", "idle"};
+	int ioprio_class = IOPRIO_PRIO_CLASS(ioprio);
+	std::string name = ioprio_class < 4 ? classes[ioprio_class] : "class " + std::to_string(ioprio_class);
+	return name + ":" + std::to_string(IOPRIO_PRIO_DATA(ioprio));
+}
+
+static size_t parse_size(const char *str)
+{
+	char *end;
+
+	size_t val = strtoull(str, &end, 10);
+
+	if (*end == '\0')
+		return val;
+	switch (*end)
+	{
+	case 'k':
+	case 'K':
+		return val * 1024ULL;
+	case 'm':
+	case 'M':
+		return val * 1024ULL * 1024ULL;
+	case 'g':
+	case 'G':
+		return val * 1024ULL * 1024ULL * 1024ULL;
+	default:
+		std::cerr << "Invalid size suffix: " << end << std::endl;
+		exit(1);
+	}
+}
+
+static void usage(const char *prog)
+{
+	std::cerr << "Usage: " << prog << " [options]\n"
+	          << "  --filename=<path>   Target device or file\n"
+	          << "  --type=<type>       I/O pattern (randread, randwrite, read, write)\n"
+	          << "  --size=<size>       Total workload size (e.g., 1g, 512m)\n"
+	          << "  --runtime=<sec>     Run for specified seconds (alternative to --size)\n"
+	          << "  --iodepth=<num>     Queue depth\n"
+	          << "  --bs=<size>         Block size (e.g., 4k)\n"
+	          << "  --mode=<mode>       I/O mode: direct (default), passthrough\n"
+	          << "  --submit=<mode>     Submission mode:\n"
+	          << "                        submit_and_wait - submit + block (default)\n"
+	          << "                        submit          - separate submit and wait calls\n"
+	          << "                        sqpoll          - kernel thread polls SQ\n"
+	          << "  --iopoll            Enable polled completions (requires poll queue support)\n"
+	          << "  --hugepage_rings    Place the rings in huge pages (needs vm.nr_hugepages, Linux 6.5+)\n"
+	          << "  --metrics_file=<path>     Write OpenMetrics text to <path>, atomically rewritten each interval\n"
+	          << "  --metrics_socket=<path>   Serve OpenMetrics text on a unix socket at <path>\n"
+	          << "  --metrics_interval=<sec>  Metrics file rewrite interval (default 10)\n"
+	          << "  --verify            Stamp writes with LBA/generation/CRC32C headers and check them on read\n"
+	          << "  --verify_seed=<n>   Payload pattern seed recorded in block headers (default 7498095)\n"
+	          << "  --buffer_compress_percentage=<pct>  Make write buffers <pct>% compressible (zero-filled)\n"
+	          << "  --dedupe_percentage=<pct>           Share of writes repeating previously written content\n"
+	          << "  --buffer_pool=<n>   Share <n> buffers per worker among all in-flight I/Os (default: one per I/O)\n"
+	          << "  --continue_on_error=<ops>  Count errors instead of aborting: read, write, all, none\n"
+	          << "  --error_retries=<n>        Resubmit a failed I/O up to <n> times (with --continue_on_error)\n"
+	          << "  --io_timeout=<ms>   Report and cancel I/Os outstanding longer than <ms>\n"
+	          << "  --slowest=<n>       Report the <n> slowest I/Os with LBA, size, op, submit time and queue depth\n"
+	          << "  --slow_threshold=<us>  Report every I/O slower than <us>\n"
+	          << "  --queue_stats       Report time-weighted queue depth at the device and a Little's law check\n"
+	          << "  --heatmap=<prefix>  Write latency heatmap CSVs to <prefix>_lba.csv and <prefix>_time.csv\n"
+	          << "  --heatmap_regions=<n>     Number of LBA regions (default 64)\n"
+	          << "  --heatmap_interval=<ms>   Time resolution of the time heatmap (default 1000)\n"
+	          << "  --trace=<path>      Record every I/O to a binary trace (analyze with rio-analyze)\n"
+	          << "  --seed=<n>          Make the workload repeatable: same seed and options, same I/O sequence\n"
+	          << "  --record_offsets=<path>  Save every worker's LBA sequence to <path>\n"
+	          << "  --replay_offsets=<path>  Issue exactly the LBA sequences saved with --record_offsets\n"
+	          << "  --name=<name>       Start a job; following options apply to it, earlier ones are defaults\n"
+	          << "  --jobfile=<path>    Read jobs from an INI-style file ([global] and one [section] per job)\n"
+	          << "  --numjobs=<n>|hwq   Workers running the job, each with its own ring (default 1); hwq runs one\n"
+	          << "                      per hardware queue, pinned to a CPU mapped to it\n"
+	          << "  --rate_iops=<n>     Cap the job at <n> IOPS\n"
+	          << "  --prio=<class>[:<level>]  I/O priority: rt, be or idle, level 0-7 (default 4)\n"
+	          << "  --prio_percentage=<pct>   Share of I/Os issued with --prio (default 100)\n"
+	          << "  --offset=<size>     Start of the region I/O is confined to (default 0)\n"
+	          << "  --io_range=<size>   Size of the region (default: to the end of the device)\n"
+	          << "  --offset_increment=<size>  Give each worker its own region, this far after the previous one\n"
+	          << "  --namespaces=<list>        Run the job on each listed nsid of the controller, or 'all'\n"
+	          << "  --isolation         Also run each job alone and report how much the others slow it down\n"
+	          << "  --sync=<name>:<n>   Start every phase together with the other <n>-1 rio processes using <name>\n"
+	          << "  --rt[=nothp]        Lock memory, run workers SCHED_FIFO and report host latency noise sources\n"
+	          << "  --server[=[<addr>:]<port>]  Run as an agent for --client coordinators (default 127.0.0.1:8765)\n"
+	          << "  --client=<agents>   Run the jobs on comma-separated host[:port] agents and merge their results\n"
+	          << "  --phase=<name>      Start a phase: the jobs run again with the options that follow\n"
+	          << "  --idle=<sec>        Idle for <sec> before the current phase\n"
+	          << "  --sweep=<key=v1,v2 ...>  Run every combination of the listed option values as phases\n";
+	exit(1);
+}
+
+constexpr int RIO_AGENT_PORT = 8765;              // default --server port
+constexpr char RIO_AGENT_ADDR[] = "127.0.0.1";    // default --server address: only local coordinators
+constexpr char RIO_AGENT_TOKEN[] = "RIO_AGENT_TOKEN"; // environment variable with the shared session token
+
+// host, host:port, [v6 address] or [v6 address]:port; host and port are left alone when absent
+static void split_host_port(const std::string &spec, std::string *host, std::string *port)
+{
+	*host = spec;
+	size_t colon = spec.rfind(':');
+	size_t bracket = spec.rfind(']');
+	if (colon != std::string::npos && (bracket != std::string::npos ? colon > bracket : spec.find(':') == colon))
+	{
+		*host = spec.substr(0, colon);
+		*port = spec.substr(colon + 1);
+	}
+	if (host->size() > 1 && host->front() == '[' && host->back() == ']')
+	{
+		*host = host->substr(1, host->size() - 2);
+	}
+}
+
+// Long-only options without a single-character mnemonic
+enum LongOption
+{
+	OPT_METRICS_FILE = 256,
+	OPT_METRICS_SOCKET,
+	OPT_METRICS_INTERVAL,
+	OPT_VERIFY,
+	OPT_VERIFY_SEED,
+	OPT_BUFFER_COMPRESS_PERCENTAGE,
+	OPT_DEDUPE_PERCENTAGE,
+	OPT_BUFFER_POOL,
+	OPT_HUGEPAGE_RINGS,
+	OPT_CONTINUE_ON_ERROR,
+	OPT_ERROR_RETRIES,
+	OPT_IO_TIMEOUT,
+	OPT_SLOWEST,
+	OPT_SLOW_THRESHOLD,
+	OPT_QUEUE_STATS,
+	OPT_HEATMAP,
+	OPT_HEATMAP_REGIONS,
+	OPT_HEATMAP_INTERVAL,
+	OPT_TRACE,
+	OPT_SEED,
+	OPT_RECORD_OFFSETS,
+	OPT_REPLAY_OFFSETS,
+	OPT_NAME,
+	OPT_JOBFILE,
+	OPT_NUMJOBS,
+	OPT_RATE_IOPS,
+	OPT_PRIO,
+	OPT_PRIO_PERCENTAGE,
+	OPT_OFFSET,
+	OPT_IO_RANGE,
+	OPT_OFFSET_INCREMENT,
+	OPT_NAMESPACES,
+	OPT_ISOLATION,
+	OPT_SYNC,
+	OPT_RT,
+	OPT_SERVER,
+	OPT_CLIENT,
+	OPT_PHASE,
+	OPT_IDLE,
+	OPT_SWEEP,
+};
+
+static const struct option long_options[] = {{"filename", required_argument, 0, 'f'},
+                                             {"type", required_argument, 0, 't'},
+                                             {"size", required_argument, 0, 's'},
+                                             {"runtime", required_argument, 0, 'r'},
+                                             {"iodepth", required_argument, 0, 'd'},
+                                             {"bs", required_argument, 0, 'b'},
+                                             {"mode", required_argument, 0, 'm'},
+                                             {"submit", required_argument, 0, 'u'},
+                                             {"iopoll", no_argument, 0, 'p'},
+                                             {"hugepage_rings", no_argument, 0, OPT_HUGEPAGE_RINGS},
+                                             {"metrics_file", required_argument, 0, OPT_METRICS_FILE},
+                                             {"metrics_socket", required_argument, 0, OPT_METRICS_SOCKET},
+                                             {"metrics_interval", required_argument, 0, OPT_METRICS_INTERVAL},
+                                             {"verify", no_argument, 0, OPT_VERIFY},
+                                             {"verify_seed", required_argument, 0, OPT_VERIFY_SEED},
+                                             {"buffer_compress_percentage", required_argument, 0,
+                                              OPT_BUFFER_COMPRESS_PERCENTAGE},
+                                             {"dedupe_percentage", required_argument, 0, OPT_DEDUPE_PERCENTAGE},
+                                             {"buffer_pool", required_argument, 0, OPT_BUFFER_POOL},
+                                             {"continue_on_error", required_argument, 0, OPT_CONTINUE_ON_ERROR},
+                                             {"error_retries", required_argument, 0, OPT_ERROR_RETRIES},
+                                             {"io_timeout", required_argument, 0, OPT_IO_TIMEOUT},
+                                             {"slowest", required_argument, 0, OPT_SLOWEST},
+                                             {"slow_threshold", required_argument, 0, OPT_SLOW_THRESHOLD},
+                                             {"queue_stats", no_argument, 0, OPT_QUEUE_STATS},
+                                             {"heatmap", required_argument, 0, OPT_HEATMAP},
+                                             {"heatmap_regions", required_argument, 0, OPT_HEATMAP_REGIONS},
+                                             {"heatmap_interval", required_argument, 0, OPT_HEATMAP_INTERVAL},
+                                             {"trace", required_argument, 0, OPT_TRACE},
+                                             {"seed", required_argument, 0, OPT_SEED},
+                                             {"record_offsets", required_argument, 0, OPT_RECORD_OFFSETS},
+                                             {"replay_offsets", required_argument, 0, OPT_REPLAY_OFFSETS},
+                                             {"name", required_argument, 0, OPT_NAME},
+                                             {"jobfile", required_argument, 0, OPT_JOBFILE},
+                                             {"numjobs", required_argument, 0, OPT_NUMJOBS},
+                                             {"rate_iops", required_argument, 0, OPT_RATE_IOPS},
+                                             {"prio", required_argument, 0, OPT_PRIO},
+                                             {"prio_percentage", required_argument, 0, OPT_PRIO_PERCENTAGE},
+                                             {"offset", required_argument, 0, OPT_OFFSET},
+                                             {"io_range", required_argument, 0, OPT_IO_RANGE},
+                                             {"offset_increment", required_argument, 0, OPT_OFFSET_INCREMENT},
+                                             {"namespaces", required_argument, 0, OPT_NAMESPACES},
+                                             {"isolation", no_argument, 0, OPT_ISOLATION},
+                                             {"sync", required_argument, 0, OPT_SYNC},
+                                             {"rt", optional_argument, 0, OPT_RT},
+                                             {"server", optional_argument, 0, OPT_SERVER},
+                                             {"client", required_argument, 0, OPT_CLIENT},
+                                             {"phase", required_argument, 0, OPT_PHASE},
+                                             {"idle", required_argument, 0, OPT_IDLE},
+                                             {"sweep", required_argument, 0, OPT_SWEEP},
+                                             {0, 0, 0, 0}};
+
+static const struct option *find_long_option(const std::string &name)
+{
+	const struct option *opt = long_options;
+	while (opt->name && name != opt->name)
+	{
+		opt++;
+	}
+	return opt->name ? opt : nullptr;
+}
+
+// Options that describe the whole run rather than one job. They apply to every job wherever they appear.
+static bool is_run_option(int opt)
+{
+	return opt == OPT_METRICS_FILE || opt == OPT_METRICS_SOCKET || opt == OPT_METRICS_INTERVAL || opt == OPT_TRACE ||
+	       opt == OPT_RECORD_OFFSETS || opt == OPT_REPLAY_OFFSETS || opt == OPT_ISOLATION || opt == OPT_SYNC ||
+	       opt == OPT_RT || opt == OPT_SERVER || opt == OPT_CLIENT;
+}
+
+static void apply_option(Config &cfg, int opt, const char *arg, const char *prog)
+{
+	switch (opt)
+	{
+	case 'f':
+		cfg.filename = arg;
+		break;
+	case 't':
+		cfg.type = arg;
+		break;
+	case 's':
+		cfg.size = parse_size(arg);
+		break;
+	case 'r':
+		cfg.runtime = atoi(arg);
+		break;
+	case 'd':
+		cfg.iodepth = atoi(arg);
+		break;
+	case 'b':
+		cfg.block_size = parse_size(arg);
+		break;
+	case 'm':
+		if (strcmp(arg, "direct") == 0)
+		{
+			cfg.passthrough = false;
+		}
+		else if (strcmp(arg, "passthrough") == 0)
+		{
+			cfg.passthrough = true;
+		}
+		else
+		{
+			std::cerr << "Invalid mode: " << arg << std::endl;
+			usage(prog);
+		}
+		break;
+	case 'u':
+		if (strcmp(arg, "submit_and_wait") == 0)
+		{
+			cfg.submit_mode = SubmitMode::SUBMIT_AND_WAIT;
+		}
+		else if (strcmp(arg, "submit") == 0)
+		{
+			cfg.submit_mode = SubmitMode::SUBMIT;
+		}
+		else if (strcmp(arg, "sqpoll") == 0)
+		{
+			cfg.submit_mode = SubmitMode::SQPOLL;
+		}
+		else
+		{
+			std::cerr << "Invalid submit mode: " << arg << std::endl;
+			usage(prog);
+		}
+		break;
+	case 'p':
+		cfg.iopoll = true;
+		break;
+	case OPT_HUGEPAGE_RINGS:
+		cfg.hugepage_rings = true;
+		break;
+	case OPT_METRICS_FILE:
+		cfg.metrics_file = arg;
+		break;
+	case OPT_METRICS_SOCKET:
+		cfg.metrics_socket = arg;
+		break;
+	case OPT_METRICS_INTERVAL:
+		cfg.metrics_interval = atoi(arg);
+		break;
+	case OPT_VERIFY:
+		cfg.verify = true;
+		break;
+	case OPT_VERIFY_SEED:
+		cfg.verify_seed = strtoull(arg, nullptr, 0);
+		break;
+	case OPT_BUFFER_COMPRESS_PERCENTAGE:
+		cfg.buffer_compress_percentage = atoi(arg);
+		break;
+	case OPT_DEDUPE_PERCENTAGE:
+		cfg.dedupe_percentage = atoi(arg);
+		break;
+	case OPT_BUFFER_POOL:
+		cfg.buffer_pool = atoi(arg);
+		break;
+	case OPT_CONTINUE_ON_ERROR:
+		cfg.continue_on_error = parse_continue_on_error(arg);
+		break;
+	case OPT_ERROR_RETRIES:
+		cfg.error_retries = atoi(arg);
+		break;
+	case OPT_IO_TIMEOUT:
+		cfg.io_timeout_ms = atoi(arg);
+		break;
+	case OPT_SLOWEST:
+		cfg.slowest = atoi(arg);
+		break;
+	case OPT_SLOW_THRESHOLD:
+		cfg.slow_threshold_us = atoi(arg);
+		break;
+	case OPT_QUEUE_STATS:
+		cfg.queue_stats = true;
+		break;
+	case OPT_HEATMAP:
+		cfg.heatmap = arg;
+		break;
+	case OPT_HEATMAP_REGIONS:
+		cfg.heatmap_regions = atoi(arg);
+		break;
+	case OPT_HEATMAP_INTERVAL:
+		cfg.heatmap_interval_ms = atoi(arg);
+		break;
+	case OPT_TRACE:
+		cfg.trace = arg;
+		break;
+	case OPT_SEED:
+		cfg.seed = strtoull(arg, nullptr, 0);
+		break;
+	case OPT_RECORD_OFFSETS:
+		cfg.record_offsets = arg;
+		break;
+	case OPT_REPLAY_OFFSETS:
+		cfg.replay_offsets = arg;
+		break;
+	case OPT_NUMJOBS:
+		// "hwq" is resolved against the device's hardware queues once it is opened
+		cfg.queue_layout = strcmp(arg, "hwq") == 0;
+		cfg.numjobs = cfg.queue_layout ? 1 : atoi(arg);
+		break;
+	case OPT_RATE_IOPS:
+		cfg.rate_iops = strtoull(arg, nullptr, 0);
+		break;
+	case OPT_PRIO:
+		cfg.ioprio = parse_ioprio(arg);
+		break;
+	case OPT_PRIO_PERCENTAGE:
+		cfg.prio_percentage = atoi(arg);
+		break;
+	case OPT_OFFSET:
+		cfg.offset = parse_size(arg);
+		break;
+	case OPT_IO_RANGE:
+		cfg.io_range = parse_size(arg);
+		break;
+	case OPT_OFFSET_INCREMENT:
+		cfg.offset_increment = parse_size(arg);
+		break;
+	case OPT_NAMESPACES:
+		cfg.namespaces = arg;
+		break;
+	case OPT_ISOLATION:
+		cfg.isolation = true;
+		break;
+	case OPT_SYNC:
+	{
+		const char *colon = strrchr(arg, ':');
+		cfg.sync_name = colon ? strndup(arg, colon - arg) : arg;
+		cfg.sync_processes = colon ? atoi(colon + 1) : 0;
+		if (!colon || colon == arg || cfg.sync_processes <= 0 || strchr(cfg.sync_name, '/'))
+		{
+			std::cerr << "Invalid --sync value: " << arg << std::endl;
+			usage(prog);
+		}
+		break;
+	}
+	case OPT_SERVER:
+	{
+		// port, address or address:port
+		std::string host = RIO_AGENT_ADDR;
+		std::string port = std::to_string(RIO_AGENT_PORT);
+		if (arg && arg[strspn(arg, "0123456789")] == '\0')
+			port = arg;
+		else if (arg)
+			split_host_port(arg, &host, &port);
+		cfg.server_addr = strdup(host.empty() ? RIO_AGENT_ADDR : host.c_str());
+		cfg.server_port = atoi(port.c_str());
+		if (cfg.server_port <= 0 || cfg.server_port > 65535)
+		{
+			std::cerr << "Invalid --server port: " << arg << std::endl;
+			usage(prog);
+		}
+		break;
+	}
+	case OPT_CLIENT:
+		cfg.client = arg;
+		break;
+	case OPT_RT:
+		if (arg && strcmp(arg, "nothp") != 0)
+		{
+			std::cerr << "Invalid --rt option: " << arg << std::endl;
+			usage(prog);
+		}
+		cfg.rt = true;
+		cfg.rt_nothp = arg != nullptr;
+		break;
+	default:
+		usage(prog);
+	}
+}
+
+// One step of a scenario: every job runs once with this phase's settings, and the phase is reported on its own
+struct Phase
+{
+	const char *name = nullptr; // null for a run without --phase
+	int idle_sec = 0;           // pause before the phase starts
+	std::vector<Config> jobs;
+	std::vector<const char *> point; // --sweep: this phase's value of each swept option
+	int solo = -1;                   // --isolation: the only job running in this phase, -1 for all of them
+};
+
+// One --sweep dimension: an option and the values it takes
+struct SweepAxis
+{
+	const struct option *opt;
+	std::vector<const char *> values;
+};
+
+struct Scenario
+{
+	std::vector<Phase> phases;
+	std::vector<SweepAxis> sweep;
+	int server_port = 0; // --server: no jobs of its own
+	const char *server_addr = nullptr;
+};
+
+// Collects job and phase definitions in command-line order. Options before the first --name (or in a [global]
+// section) are defaults, and each --name starts a new job from a copy of the defaults as they stand at that point.
+// Each --phase then starts from a copy of the previous phase's jobs; options in a phase apply to all of its jobs, or
+// to the one picked out by --name.
+struct JobParser
+{
+	const char *prog;
+	Config global;
+	std::vector<Config> jobs;
+	std::vector<Phase> phases;
+	std::vector<SweepAxis> sweep;
+	int current = -1; // index into jobs (or into the current phase's jobs), -1 while defining defaults or all jobs
+
+	void option(int opt, const char *arg)
+	{
+		if (opt == OPT_PHASE)
+		{
+			Phase phase;
+			phase.name = arg;
+			phase.jobs = !phases.empty() ? phases.back().jobs : !jobs.empty() ? jobs : std::vector<Config> {global};
+			phases.push_back(phase);
+			current = -1;
+		}
+		else if (opt == OPT_IDLE)
+		{
+			if (phases.empty())
+			{
+				std::cerr << "Error: --idle must follow a --phase" << std::endl;
+				exit(1);
+			}
+			phases.back().idle_sec = atoi(arg);
+		}
+		else if (opt == OPT_NAME && !phases.empty())
+		{
+			// Within a phase, --name picks out an existing job
+			std::vector<Config> &phase_jobs = phases.back().jobs;
+			current = -1;
+			for (size_t i = 0; i < phase_jobs.size(); i++)
+			{
+				if (phase_jobs[i].name && strcmp(phase_jobs[i].name, arg) == 0)
+					current = (int)i;
+			}
+			if (current < 0)
+			{
+				std::cerr << "Error: phase '" << phases.back().name << "': no job named '" << arg << "'"
+				          << std::endl;
+				exit(1);
+			}
+		}
+		else if (opt == OPT_NAME)
+		{
+			jobs.push_back(global);
+			jobs.back().name = arg;
+			current = (int)jobs.size() - 1;
+		}
+		else if (opt == OPT_JOBFILE)
+		{
+			load_job_file(arg);
+		}
+		else if (opt == OPT_SWEEP)
+		{
+			add_sweep(arg);
+		}
+		else if (is_run_option(opt))
+		{
+			apply_option(global, opt, arg, prog);
+			for (Config &job : jobs)
+			{
+				apply_option(job, opt, arg, prog);
+			}
+			for (Phase &phase : phases)
+			{
+				for (Config &job : phase.jobs)
+				{
+					apply_option(job, opt, arg, prog);
+				}
+			}
+		}
+		else if (!phases.empty())
+		{
+			// Every phase runs the same jobs, and --namespaces would turn one job into several in this phase only
+			if (opt == OPT_NAMESPACES)
+			{
+				std::cerr << "Error: phase '" << phases.back().name << "': --namespaces must be set before the first "
+				          << "--phase" << std::endl;
+				exit(1);
+			}
+			std::vector<Config> &phase_jobs = phases.back().jobs;
+			for (size_t i = 0; i < phase_jobs.size(); i++)
+			{
+				if (current < 0 || (int)i == current)
+					apply_option(phase_jobs[i], opt, arg, prog);
+			}
+		}
+		else
+		{
+			apply_option(current < 0 ? global : jobs[current], opt, arg, prog);
+		}
+	}
+
+	// --sweep: whitespace-separated `key=v1,v2,...` lists, each a job option and the values to run it with
+	void add_sweep(const char *arg)
+	{
+		std::istringstream in(arg);
+		std::string item;
+		while (in >> item)
+		{
+			size_t eq = item.find('=');
+			const struct option *opt = eq == std::string::npos ? nullptr : find_long_option(item.substr(0, eq));
+			if (!opt || opt->has_arg != required_argument || is_run_option(opt->val) || opt->val == OPT_NAME ||
+			    opt->val == OPT_JOBFILE || opt->val == OPT_PHASE || opt->val == OPT_IDLE || opt->val == OPT_SWEEP ||
+			    opt->val == OPT_NAMESPACES)
+			{
+				std::cerr << "Error: invalid --sweep option '" << item << "'" << std::endl;
+				exit(1);
+			}
+
+			SweepAxis axis {opt, {}};
+			std::istringstream values(item.substr(eq + 1));
+			std::string value;
+			while (std::getline(values, value, ','))
+			{
+				axis.values.push_back(strdup(value.c_str()));
+			}
+			if (axis.values.empty())
+			{
+				std::cerr << "Error: --sweep option '" << item << "' has no values" << std::endl;
+				exit(1);
+			}
+			sweep.push_back(axis);
+		}
+	}
+
+	// INI-style job file: [global] holds defaults, [phase <name>] starts a phase, every other [section] is a job
+	// named after it, and each `key=value` line is the long option of the same name. Values are kept for the life of
+	// the process.
+	void load_job_file(const char *path)
+	{
+		std::ifstream in(path);
+		if (!in)
+		{
+			std::cerr << "Error: Cannot open job file " << path << std::endl;
+			exit(1);
+		}
+
+		std::string line;
+		for (int lineno = 1; std::getline(in, line); lineno++)
+		{
+			auto trim = [](std::string s)
+			{
+				size_t begin = s.find_first_not_of(" \t\r");
+				size_t end = s.find_last_not_of(" \t\r");
+				return begin == std::string::npos ? std::string() : s.substr(begin, end - begin + 1);
+			};
+			line = trim(line);
+			if (line.empty() || line[0] == '#' || line[0] == ';')
+				continue;
+
+			if (line.front() == '[' && line.back() == ']')
+			{
+				std::string section = trim(line.substr(1, line.size() - 2));
+				if (section == "global")
+					current = -1;
+				else if (section.compare(0, 6, "phase ") == 0)
+					option(OPT_PHASE, strdup(trim(section.substr(6)).c_str()));
+				else
+					option(OPT_NAME, strdup(section.c_str()));
+				continue;
+			}
+
+			size_t eq = line.find('=');
+			std::string key = trim(line.substr(0, eq));
+			const struct option *opt = find_long_option(key);
+			if (!opt || opt->val == OPT_NAME || opt->val == OPT_JOBFILE || opt->val == OPT_PHASE ||
+			    (opt->has_arg == required_argument) != (eq != std::string::npos))
+			{
+				std::cerr << "Error: " << path << ":" << lineno << ": invalid option '" << line << "'" << std::endl;
+				exit(1);
+			}
+			option(opt->val, eq == std::string::npos ? nullptr : strdup(trim(line.substr(eq + 1)).c_str()));
+		}
+	}
+};
+
+// The SQ only needs to hold what is queued between two submits, so it stops growing with the queue depth; get_sqe()
+// flushes it when a larger batch fills it. The CQ must hold a completion for every I/O in flight, plus the CQEs of
+// --io_timeout cancellations, and is sized separately.
+constexpr unsigned RING_SQ_ENTRIES = 1024;
+
+// --hugepage_rings: ring memory provided by rio (IORING_SETUP_NO_MMAP) instead of kernel pages mapped 4 KiB at a
+// time, so the SQEs and CQEs the hot loop walks sit in one or two TLB entries
+constexpr size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+// SQE array, CQ ring and SQ index array, plus a page each for the ring headers and alignment. liburing lays them out
+// back to back in the memory it is given, and the kernel only accepts a region that lies within one huge page, so
+// --hugepage_rings rejects queue depths whose rings do not fit in one.
+static size_t hugepage_ring_bytes(int queue_depth, bool passthrough)
+{
+	size_t sqe_size = passthrough ? 128 : 64;
+	size_t cqe_size = passthrough ? 32 : 16;
+	unsigned sq_entries = std::min<unsigned>(queue_depth, RING_SQ_ENTRIES);
+	return std::bit_ceil(sq_entries) * (sqe_size + sizeof(unsigned)) +
+	       std::bit_ceil(2u * queue_depth) * cqe_size + 2 * 4096;
+}
+
+static void validate_config(const Config &cfg, const char *prog)
+{
+	// Prefix errors with the job they belong to
+	auto fail = [&](const char *msg)
+	{
+		std::cerr << "Error: ";
+		if (cfg.name)
+			std::cerr << "job '" << cfg.name << "': ";
+		std::cerr << msg << "\n";
+	};
+
+	if (!cfg.filename || !cfg.type || cfg.iodepth == 0 || cfg.block_size == 0)
+	{
+		fail("Required parameters missing");
+		usage(prog);
+	}
+
+	if (cfg.iodepth < 0 || cfg.iodepth > MAX_IODEPTH)
+	{
+		fail(("--iodepth must be within 1-" + std::to_string(MAX_IODEPTH)).c_str());
+		exit(1);
+	}
+
+	if (cfg.size == 0 && cfg.runtime == 0)
+	{
+		fail("Either --size or --runtime is required");
+		usage(prog);
+	}
+
+	if (strcmp(cfg.type, "randread") != 0 && strcmp(cfg.type, "randwrite") != 0 && strcmp(cfg.type, "read") != 0 &&
+	    strcmp(cfg.type, "write") != 0)
+	{
+		fail("Only 'randread', 'randwrite', 'read' and 'write' types are supported");
+		exit(1);
+	}
+
+	if (cfg.metrics_interval <= 0)
+	{
+		fail("--metrics_interval must be positive");
+		exit(1);
+	}
+
+	if (cfg.buffer_compress_percentage < -1 || cfg.buffer_compress_percentage > 100 || cfg.dedupe_percentage < 0 ||
+	    cfg.dedupe_percentage > 100)
+	{
+		fail("--buffer_compress_percentage and --dedupe_percentage must be within 0-100");
+		exit(1);
+	}
+
+	if (cfg.buffer_pool < 0)
+	{
+		fail("--buffer_pool must not be negative");
+		exit(1);
+	}
+
+	// Pooled buffers are written by several I/Os at once, so only I/O whose data does not matter can share them
+	if (cfg.buffer_pool > 0 && (cfg.verify || cfg.buffer_compress_percentage >= 0 || cfg.dedupe_percentage > 0))
+	{
+		fail("--buffer_pool cannot be combined with --verify, --buffer_compress_percentage or --dedupe_percentage");
+		exit(1);
+	}
+
+	if (cfg.error_retries < 0 || cfg.io_timeout_ms < 0 || cfg.slowest < 0 || cfg.slow_threshold_us < 0)
+	{
+		fail("--error_retries, --io_timeout, --slowest and --slow_threshold must not be negative");
+		exit(1);
+	}
+
+	if (cfg.hugepage_rings && hugepage_ring_bytes(cfg.iodepth, cfg.passthrough) > HUGE_PAGE_SIZE)
+	{
+		int max_iodepth = cfg.iodepth;
+		while (max_iodepth > 1 && hugepage_ring_bytes(max_iodepth, cfg.passthrough) > HUGE_PAGE_SIZE)
+		{
+			max_iodepth--;
+		}
+		fail(("--hugepage_rings: the rings must fit in one 2 MiB huge page, which holds them up to --iodepth=" +
+		      std::to_string(max_iodepth) + (cfg.passthrough ? " in passthrough mode" : ""))
+		         .c_str());
+		exit(1);
+	}
+
+	if (cfg.heatmap_regions <= 0 || cfg.heatmap_interval_ms <= 0)
+	{
+		fail("--heatmap_regions and --heatmap_interval must be positive");
+		exit(1);
+	}
+
+	if (cfg.numjobs <= 0)
+	{
+		fail("--numjobs must be positive");
+		exit(1);
+	}
+
+	if (cfg.rate_iops > 0 && cfg.rate_iops < (uint64_t)cfg.numjobs)
+	{
+		fail("--rate_iops must be at least --numjobs");
+		exit(1);
+	}
+
+	if (cfg.prio_percentage < 0 || cfg.prio_percentage > 100)
+	{
+		fail("--prio_percentage must be within 0-100");
+		exit(1);
+	}
+
+	// The block layer schedules by ioprio, but NVMe commands carry no priority of their own: arbitration, weighted
+	// round robin included, is per submission queue. uring_cmd bypasses the scheduler, so the class would be ignored.
+	if (cfg.ioprio && cfg.passthrough)
+	{
+		fail("--prio is not supported with --mode=passthrough");
+		exit(1);
+	}
+
+	// Dedupe writes share buffers across LBAs, which cannot carry per-LBA verify headers
+	if (cfg.verify && cfg.dedupe_percentage > 0)
+	{
+		fail("--verify cannot be combined with --dedupe_percentage");
+		exit(1);
+	}
+
+	// Verified writes pick their own non-overlapping random LBAs
+	if (cfg.verify && strstr(cfg.type, "write") && cfg.replay_offsets)
+	{
+		fail("--replay_offsets cannot replay verified writes");
+		exit(1);
+	}
+	if (cfg.verify && strcmp(cfg.type, "write") == 0)
+	{
+		fail("--verify supports randwrite, not sequential write");
+		exit(1);
+	}
+}
+
+// Expand --sweep into one phase per combination of values, the first axis varying slowest
+static std::vector<Phase> expand_sweep(const std::vector<Config> &jobs, const std::vector<SweepAxis> &sweep,
+                                       const char *prog)
+{
+	std::vector<Phase> phases;
+	std::vector<size_t> index(sweep.size(), 0);
+	for (;;)
+	{
+		Phase phase;
+		phase.jobs = jobs;
+		std::string name;
+		for (size_t a = 0; a < sweep.size(); a++)
+		{
+			const char *value = sweep[a].values[index[a]];
+			for (Config &job : phase.jobs)
+			{
+				apply_option(job, sweep[a].opt->val, value, prog);
+			}
+			phase.point.push_back(value);
+			if (a > 0)
+			{
+				name += ',';
+			}
+			name += sweep[a].opt->name;
+			name += '=';
+			name += value;
+		}
+		phase.name = strdup(name.c_str());
+		phases.push_back(phase);
+
+		size_t a = sweep.size();
+		while (a > 0 && ++index[a - 1] == sweep[a - 1].values.size())
+		{
+			index[--a] = 0;
+		}
+		if (a == 0)
+		{
+			return phases;
+		}
+	}
+}
+
+static Scenario parse_args(int argc, char **argv)
+{
+	JobParser parser;
+	parser.prog = argv[0];
+
+	int opt;
+	while ((opt = getopt_long(argc, argv, "", long_options, nullptr)) != -1)
+	{
+		if (opt == '?')
+		{
+			usage(argv[0]);
+		}
+		parser.option(opt, optarg);
+		// --sweep bs=4k,128k iodepth=1,32: the unquoted form passes each axis as its own word
+		while (opt == OPT_SWEEP && optind < argc && argv[optind][0] != '-' && strchr(argv[optind], '='))
+		{
+			parser.add_sweep(argv[optind++]);
+		}
+	}
+	if (optind < argc)
+	{
+		std::cerr << "Unexpected argument: " << argv[optind] << "\n";
+		usage(argv[0]);
+	}
+
+	// An agent gets its jobs from the coordinator
+	Scenario scenario;
+	if (parser.global.server_port)
+	{
+		scenario.server_port = parser.global.server_port;
+		scenario.server_addr = parser.global.server_addr;
+		return scenario;
+	}
+
+	// Without --phase or --sweep the jobs run once, as a single unnamed phase
+	std::vector<Phase> &phases = scenario.phases;
+	std::vector<Config> jobs = parser.jobs.empty() ? std::vector<Config> {parser.global} : parser.jobs;
+	if (!parser.sweep.empty())
+	{
+		if (!parser.phases.empty())
+		{
+			std::cerr << "Error: --sweep and --phase cannot be combined\n";
+			exit(1);
+		}
+		phases = expand_sweep(jobs, parser.sweep, argv[0]);
+		scenario.sweep = parser.sweep;
+	}
+	else if (!parser.phases.empty())
+	{
+		phases = parser.phases;
+	}
+	else
+	{
+		phases.push_back({});
+		phases[0].jobs = jobs;
+	}
+
+	for (const Phase &phase : phases)
+	{
+		if (phase.idle_sec < 0)
+		{
+			std::cerr << "Error: --idle must not be negative\n";
+			exit(1);
+		}
+
+		const std::vector<Config> &jobs = phase.jobs;
+		for (const Config &job : jobs)
+		{
+			validate_config(job, argv[0]);
+		}
+
+		// Verified write jobs must own their target; another writer would invalidate the expected block contents
+		for (size_t i = 0; i < jobs.size(); i++)
+		{
+			for (size_t j = 0; j < jobs.size(); j++)
+			{
+				bool writer_i = jobs[i].verify && strcmp(jobs[i].type, "randwrite") == 0;
+				bool writer_j = strcmp(jobs[j].type, "randwrite") == 0 || strcmp(jobs[j].type, "write") == 0;
+				if (i != j && writer_i && writer_j && strcmp(jobs[i].filename, jobs[j].filename) == 0)
+				{
+					std::cerr << "Error: --verify write jobs cannot share their target with another write job\n";
+					exit(1);
+				}
+			}
+		}
+	}
+
+	return scenario;
+}
+
+struct RingMemory
+{
+	void *addr = nullptr;
+	size_t size = 0;
+};
+
+// mem is null for kernel-allocated rings; otherwise it receives the huge pages backing the ring, to be unmapped
+// after io_uring_queue_exit()
+static void setup_io_uring(struct io_uring *ring, int queue_depth, bool passthrough, SubmitMode submit_mode,
+                           bool iopoll, RingMemory *mem)
+{
+	struct io_uring_params params = {};
+	params.flags = IORING_SETUP_CQSIZE;
+	params.cq_entries = 2 * queue_depth;
+	if (passthrough)
+	{
+		params.flags |= IORING_SETUP_SQE128 | IORING_SETUP_CQE32;
+	}
+	if (iopoll)
+	{
+		params.flags |= IORING_SETUP_IOPOLL;
+	}
+	if (submit_mode == SubmitMode::SQPOLL)
+	{
+		params.flags |= IORING_SETUP_SQPOLL | IORING_SETUP_SINGLE_ISSUER;
+		params.sq_thread_idle = 2000; // ms before kernel thread goes idle
+	}
+	else if (!iopoll)
+	{
+		// Defer completion work to io_uring_enter() for better batching
+		// Note: DEFER_TASKRUN is incompatible with IOPOLL
+		params.flags |= IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN;
+	}
+	else
+	{
+		params.flags |= IORING_SETUP_SINGLE_ISSUER;
+	}
+	unsigned sq_entries = std::min<unsigned>(queue_depth, RING_SQ_ENTRIES);
+	if (!mem)
+	{
+		int ret = io_uring_queue_init_params(sq_entries, ring, &params);
+		if (ret < 0)
+		{
+			fatal_error("io_uring_queue_init failed", ret);
+		}
+		return;
+	}
+
+	// validate_config() made sure this fits in one huge page
+	mem->size = HUGE_PAGE_SIZE;
+	mem->addr = mmap(nullptr, mem->size, PROT_READ | PROT_WRITE,
+	                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE, -1, 0);
+	if (mem->addr == MAP_FAILED)
+	{
+		fatal_error("--hugepage_rings: no free huge pages; reserve some with sysctl vm.nr_hugepages", -errno);
+	}
+	int ret = io_uring_queue_init_mem(sq_entries, ring, &params, mem->addr, mem->size);
+	if (ret < 0)
+	{
+		fatal_error(ret == -EINVAL ? "io_uring_queue_init_mem failed; IORING_SETUP_NO_MMAP needs Linux 6.5"
+		                           : "io_uring_queue_init_mem failed",
+		            ret);
+	}
+}
+
+static void free_ring_memory(RingMemory *mem)
+{
+	if (mem->addr)
+	{
+		munmap(mem->addr, mem->size);
+		*mem = RingMemory {};
+	}
+}
+
+// An SQE, flushing the SQ to the kernel first when it is full. Only SQPOLL leaves SQEs queued after a submit, so only
+// then is there anything to wait for.
+static struct io_uring_sqe *get_sqe(struct io_uring *ring)
+{
+	struct io_uring_sqe *sqe;
+	while (!(sqe = io_uring_get_sqe(ring)))
+	{
+		int ret = io_uring_submit(ring);
+		if (ret < 0)
+		{
+			fatal_error("io_uring_submit failed", ret);
+		}
+		if (ring->flags & IORING_SETUP_SQPOLL)
+		{
+			io_uring_sqring_wait(ring);
+		}
+	}
+	return sqe;
+}
+
+static std::string block_to_char_device(const char *path)
+{
+	namespace fs = std::filesystem;
+	fs::path p = path;
+
+	// Follow symlinks to get the actual device path
+	std::error_code ec;
+	while (fs::is_symlink(p, ec))
+	{
+		fs::path target = fs::read_symlink(p, ec);
+		if (ec)
+		{
+			std::cerr << "Warning: Failed to resolve symlink " << p << ": " << ec.message() << std::endl;
+			break;
+		}
+		// Handle relative symlinks
+		if (target.is_relative())
+		{
+			p = p.parent_path() / target;
+		}
+		else
+		{
+			p = target;
+		}
+	}
+
+	std::string resolved = p.string();
+
+	// Validate it's an NVMe device
+	bool has_nvme = resolved.find("nvme") != std::string::npos;
+	bool has_ng = resolved.find("ng") != std::string::npos;
+
+	if (!has_nvme && !has_ng)
+	{
+		std::cerr << "Warning: Device path '" << resolved << "' doesn't appear to be an NVMe device" << std::endl;
+		return resolved;
+	}
+
+	// If already a character device (ng), return as-is
+	if (has_ng && !has_nvme)
+	{
+		return resolved;
+	}
+
+	// Convert nvme -> ng for character device
+	size_t pos = resolved.find("nvme");
+	if (pos != std::string::npos)
+	{
+		resolved.replace(pos, 4, "ng");
+	}
+
+	return resolved;
+}
+
+static void open_nvme_ssd(const char *path, bool passthrough, NVMeDevice *nvme)
+{
+	std::string device_path = path;
+	int flags = O_RDWR;
+	if (passthrough)
+	{
+		device_path = block_to_char_device(path);
+	}
+	else
+	{
+		flags |= O_DIRECT;
+	}
+	nvme->fd = open(device_path.c_str(), flags);
+	if (nvme->fd < 0)
+	{
+		fatal_error("Failed to open device");
+	}
+
+	if (passthrough)
+	{
+		// Query namespace ID
+		if (ioctl(nvme->fd, NVME_IOCTL_ID, &nvme->nsid) < 0) // io control operation
+		{
+			close(nvme->fd);
+			fatal_error("Failed to get namespace ID");
+		}
+
+		// Get namespace info using Identify Namespace command
+		char identify_data[4096];
+		memset(identify_data, 0, sizeof(identify_data));
+		struct nvme_passthru_cmd cmd = {
+		    .opcode = nvme_admin_identify,           // eg identify, read, write
+		    .nsid = nvme->nsid,                      // namespace id
+		    .addr = (uint64_t)identify_data,         // user-space address for data buffer
+		    .data_len = 4096,                        // data buffer length
+		    .cdw10 = NVME_IDENTIFY_CNS_NS,           // data structure being requested
+		    .cdw11 = (uint32_t)NVME_CSI_NVM << 24,   // logical blocks store (vs key value store vs zones store)
+		    .timeout_ms = NVME_DEFAULT_IOCTL_TIMEOUT // default timeout
+		};
+
+		if (ioctl(nvme->fd, NVME_IOCTL_ADMIN_CMD, &cmd) < 0)
+		{
+			close(nvme->fd);
+			fatal_error("Failed to identify namespace");
+		}
+		struct nvme_id_ns *ns = (struct nvme_id_ns *)identify_data;
+		int lba_format_index = ns->flbas & 0x0F;
+		int lbads = ns->lbaf[lba_format_index].ds; // get 'data size' of LBA format entry
+
+		nvme->lba_size = 1 << lbads; // eg ds=9, lba_size = 2^9 = 512 bytes
+		nvme->nlba = ns->nsze;
+	}
+	else
+	{
+		// Direct mode: use standard block device ioctls
+		uint64_t size_bytes;
+		if (ioctl(nvme->fd, BLKGETSIZE64, &size_bytes) < 0)
+		{
+			close(nvme->fd);
+			fatal_error("Failed to get device size");
+		}
+
+		int logical_block_size;
+		if (ioctl(nvme->fd, BLKSSZGET, &logical_block_size) < 0)
+		{
+			close(nvme->fd);
+			fatal_error("Failed to get logical block size");
+		}
+
+		nvme->lba_size = logical_block_size;
+		nvme->nlba = size_bytes / nvme->lba_size;
+		nvme->nsid = 0; // N/A
+	}
+}
+
+// Active namespaces of the controller behind `path` (the controller, e.g. /dev/nvme0, or any of its namespaces),
+// as (nsid, block device) pairs. The nsids come from Identify (active namespace list); device nodes are looked up
+// in the controller's sysfs directory.
+static std::vector<std::pair<uint32_t, std::string>> discover_namespaces(const char *path)
+{
+	namespace fs = std::filesystem;
+	std::error_code ec;
+	std::string name = fs::canonical(path, ec).filename().string();
+	std::smatch match;
+	if (ec || !std::regex_match(name, match, std::regex("(?:nvme|ng)(\\d+)(?:c\\d+)?(?:n\\d+)?")))
+	{
+		std::cerr << "Error: --namespaces needs an NVMe controller or namespace, not " << path << std::endl;
+		exit(1);
+	}
+	std::string ctrl = "nvme" + match[1].str();
+
+	int fd = open(("/dev/" + ctrl).c_str(), O_RDONLY);
+	if (fd < 0)
+	{
+		fatal_error(("Failed to open /dev/" + ctrl).c_str(), -errno);
+	}
+	struct nvme_ns_list list = {};
+	struct nvme_passthru_cmd cmd = {
+	    .opcode = nvme_admin_identify,
+	    .nsid = 0, // list active nsids above this one
+	    .addr = (uint64_t)&list,
+	    .data_len = sizeof(list),
+	    .cdw10 = NVME_IDENTIFY_CNS_NS_ACTIVE_LIST,
+	    .timeout_ms = NVME_DEFAULT_IOCTL_TIMEOUT,
+	};
+	if (ioctl(fd, NVME_IOCTL_ADMIN_CMD, &cmd) < 0)
+	{
+		close(fd);
+		fatal_error("Failed to list active namespaces");
+	}
+	close(fd);
+
+	// Namespace disks appear under the controller as nvmeXnY, or nvmeXcZnY (paths of a multipath nvmeXnY)
+	std::map<uint32_t, std::string> devices;
+	std::regex disk("(nvme\\d+)(?:c\\d+)?(n\\d+)");
+	for (const fs::directory_entry &entry : fs::directory_iterator("/sys/class/nvme/" + ctrl, ec))
+	{
+		std::string disk_name = entry.path().filename().string();
+		std::ifstream nsid_file(entry.path() / "nsid");
+		uint32_t nsid;
+		if (std::regex_match(disk_name, match, disk) && nsid_file >> nsid)
+		{
+			devices[nsid] = "/dev/" + match[1].str() + match[2].str();
+		}
+	}
+
+	std::vector<std::pair<uint32_t, std::string>> namespaces;
+	for (int i = 0; i < NVME_ID_NS_LIST_MAX && list.ns[i] != 0; i++)
+	{
+		auto it = devices.find(list.ns[i]);
+		if (it == devices.end())
+		{
+			std::cerr << "Warning: namespace " << list.ns[i] << " of " << ctrl << " has no block device, skipped"
+			          << std::endl;
+			continue;
+		}
+		namespaces.push_back(*it);
+	}
+	return namespaces;
+}
+
+// --namespaces: replace each such job by one job per selected namespace, named after its nsid. Every namespace has
+// its own device, LBA format and workers.
+static void expand_namespaces(Scenario *scenario)
+{
+	std::map<std::string, std::vector<std::pair<uint32_t, std::string>>> discovered;
+	for (Phase &phase : scenario->phases)
+	{
+		std::vector<Config> jobs;
+		for (const Config &job : phase.jobs)
+		{
+			if (!job.namespaces)
+			{
+				jobs.push_back(job);
+				continue;
+			}
+
+			if (!discovered.count(job.filename))
+			{
+				discovered[job.filename] = discover_namespaces(job.filename);
+			}
+			std::vector<uint32_t> selected;
+			if (strcmp(job.namespaces, "all") != 0)
+			{
+				std::istringstream list(job.namespaces);
+				std::string item;
+				while (std::getline(list, item, ','))
+				{
+					selected.push_back(strtoul(item.c_str(), nullptr, 0));
+				}
+			}
+
+			size_t first = jobs.size();
+			for (const auto &[nsid, device] : discovered[job.filename])
+			{
+				if (!selected.empty() && std::find(selected.begin(), selected.end(), nsid) == selected.end())
+				{
+					continue;
+				}
+				Config ns_job = job;
+				std::string name = job.name ? std::string(job.name) + "-" : std::string();
+				name += "ns" + std::to_string(nsid);
+				ns_job.name = strdup(name.c_str());
+				ns_job.filename = strdup(device.c_str());
+				ns_job.namespaces = nullptr;
+				jobs.push_back(ns_job);
+			}
+			if (jobs.size() - first != (selected.empty() ? discovered[job.filename].size() : selected.size()))
+			{
+				std::cerr << "Error: --namespaces=" << job.namespaces << " does not match the active namespaces of "
+				          << job.filename << std::endl;
+				exit(1);
+			}
+		}
+		phase.jobs = jobs;
+	}
+}
+
+// --isolation: run every job alone first, then all of them together as before
+static void add_isolation_phases(Scenario *scenario)
+{
+	if (scenario->phases.size() != 1 || scenario->phases[0].name)
+	{
+		std::cerr << "Error: --isolation cannot be combined with --phase or --sweep" << std::endl;
+		exit(1);
+	}
+	Phase shared = scenario->phases[0];
+	if (shared.jobs.size() < 2)
+	{
+		std::cerr << "Error: --isolation needs at least two jobs" << std::endl;
+		exit(1);
+	}
+
+	scenario->phases.clear();
+	for (size_t j = 0; j < shared.jobs.size(); j++)
+	{
+		Phase solo = shared;
+		solo.name = strdup(("solo-" + std::string(shared.jobs[j].name)).c_str());
+		solo.solo = (int)j;
+		scenario->phases.push_back(solo);
+	}
+	shared.name = "shared";
+	scenario->phases.push_back(shared);
+}
+
+// blk-mq topology of a block device: the CPUs mapped to each hardware queue, grouped into queue maps (default, then
+// read and poll queues where the driver sets them up), and whether the device has poll queues for --iopoll
+struct QueueTopology
+{
+	std::vector<std::vector<std::vector<int>>> maps; // map -> hardware queue -> CPUs
+	bool poll_queues = false;
+};
+
+// sysfs directory of the whole-disk block device behind `path` (char devices ngXnY map to nvmeXnY)
+static std::filesystem::path sysfs_block_dir(const char *path)
+{
+	namespace fs = std::filesystem;
+	std::error_code ec;
+	std::string name = fs::canonical(path, ec).filename().string();
+	std::smatch match;
+	if (std::regex_match(name, match, std::regex("ng(\\d+n\\d+)")))
+	{
+		name = "nvme" + match[1].str();
+	}
+	fs::path dir = fs::canonical(fs::path("/sys/class/block") / name, ec);
+	if (fs::exists(dir / "partition", ec))
+	{
+		dir = dir.parent_path();
+	}
+	return dir;
+}
+
+// cpu_list formats: "0-3,8-11" and older "0, 1, 2, 3"
+static std::vector<int> parse_cpu_list(const std::string &list)
+{
+	std::vector<int> cpus;
+	std::istringstream in(list);
+	std::string item;
+	while (std::getline(in, item, ','))
+	{
+		int first, last;
+		int n = sscanf(item.c_str(), "%d-%d", &first, &last);
+		for (int cpu = first; n >= 1 && cpu <= (n == 2 ? last : first); cpu++)
+		{
+			cpus.push_back(cpu);
+		}
+	}
+	return cpus;
+}
+
+static QueueTopology read_queue_topology(const char *path)
+{
+	namespace fs = std::filesystem;
+	QueueTopology topo;
+	fs::path dir = sysfs_block_dir(path);
+
+	std::ifstream io_poll(dir / "queue" / "io_poll");
+	int poll = 0;
+	topo.poll_queues = io_poll >> poll && poll == 1;
+
+	std::error_code ec;
+	std::map<int, std::vector<int>> queues;
+	for (const fs::directory_entry &entry : fs::directory_iterator(dir / "mq", ec))
+	{
+		std::string name = entry.path().filename().string();
+		std::ifstream cpu_list(entry.path() / "cpu_list");
+		std::string list;
+		if (!name.empty() && std::all_of(name.begin(), name.end(), ::isdigit) && std::getline(cpu_list, list))
+		{
+			queues[std::stoi(name)] = parse_cpu_list(list);
+		}
+	}
+
+	// Every map covers all CPUs once, so a CPU seen again starts the next map
+	std::vector<bool> seen;
+	for (const auto &[index, cpus] : queues)
+	{
+		bool repeat = topo.maps.empty();
+		for (int cpu : cpus)
+		{
+			repeat |= cpu < (int)seen.size() && seen[cpu];
+		}
+		if (repeat)
+		{
+			topo.maps.emplace_back();
+			seen.assign(seen.size(), false);
+		}
+		for (int cpu : cpus)
+		{
+			seen.resize(std::max<size_t>(seen.size(), cpu + 1), false);
+			seen[cpu] = true;
+		}
+		topo.maps.back().push_back(cpus);
+	}
+	return topo;
+}
+
+// --numjobs=hwq: one worker per hardware queue of the job's device, pinned to the first CPU mapped to that queue
+// that the process may run on. --iopoll jobs use the poll queues, others the default queues.
+static void apply_queue_layout(Scenario *scenario)
+{
+	std::map<std::string, QueueTopology> topologies;
+	cpu_set_t allowed;
+	if (sched_getaffinity(0, sizeof(allowed), &allowed) < 0)
+	{
+		fatal_error("sched_getaffinity failed", -errno);
+	}
+
+	for (Phase &phase : scenario->phases)
+	{
+		for (Config &job : phase.jobs)
+		{
+			if (!job.queue_layout)
+			{
+				continue;
+			}
+			if (!topologies.count(job.filename))
+			{
+				topologies[job.filename] = read_queue_topology(job.filename);
+			}
+			const QueueTopology &topo = topologies[job.filename];
+			if (topo.maps.empty())
+			{
+				std::cerr << "Error: no blk-mq hardware queues found for " << job.filename << std::endl;
+				exit(1);
+			}
+
+			bool use_poll = job.iopoll && topo.poll_queues && topo.maps.size() > 1;
+			const std::vector<std::vector<int>> &queues = use_poll ? topo.maps.back() : topo.maps.front();
+			job.worker_cpus.clear();
+			for (const std::vector<int> &cpus : queues)
+			{
+				auto cpu = std::find_if(cpus.begin(), cpus.end(), [&](int c) { return CPU_ISSET(c, &allowed); });
+				if (cpu != cpus.end())
+				{
+					job.worker_cpus.push_back(*cpu);
+				}
+			}
+			if (job.worker_cpus.empty())
+			{
+				std::cerr << "Error: --numjobs=hwq found no hardware queue of " << job.filename
+				          << " mapped to an allowed CPU" << std::endl;
+				exit(1);
+			}
+			if (job.rate_iops > 0 && job.rate_iops < job.worker_cpus.size())
+			{
+				std::cerr << "Error: --rate_iops must be at least the number of hardware queues with --numjobs=hwq"
+				          << std::endl;
+				exit(1);
+			}
+			job.numjobs = (int)job.worker_cpus.size();
+			if (&phase == &scenario->phases[0])
+			{
+				std::cout << "Queue layout: " << (job.name ? "job " + std::string(job.name) + ", " : "") << job.filename
+				          << ", " << queues.size() << (use_poll ? " poll" : "")
+				          << " hardware queue(s), workers on CPUs";
+				for (int cpu : job.worker_cpus)
+				{
+					std::cout << " " << cpu;
+				}
+				std::cout << "\n";
+			}
+		}
+	}
+}
+
+// --rt: latency-stability run mode. Memory is locked (which also prefaults every later allocation, buffers and rings
+// included), workers run SCHED_FIFO, and host settings that add latency noise are reported up front.
+constexpr int RT_PRIORITY = 49;             // below threaded IRQ handlers (50), so completions are never held off
+constexpr int RT_CSTATE_LATENCY_US = 10;    // deeper idle states show up as latency outliers at low queue depth
+
+static std::string read_sysfs_line(const std::filesystem::path &path)
+{
+	std::ifstream in(path);
+	std::string line;
+	std::getline(in, line);
+	return line;
+}
+
+static std::string format_cpu_list(const std::vector<int> &cpus)
+{
+	std::string out;
+	for (size_t i = 0; i < cpus.size();)
+	{
+		size_t j = i;
+		while (j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1)
+		{
+			j++;
+		}
+		if (!out.empty())
+		{
+			out += ',';
+		}
+		out += std::to_string(cpus[i]);
+		if (j > i)
+		{
+			out += '-';
+			out += std::to_string(cpus[j]);
+		}
+		i = j + 1;
+	}
+	return out;
+}
+
+static void enter_rt_mode(bool disable_thp)
+{
+	if (disable_thp && prctl(PR_SET_THP_DISABLE, 1, 0, 0, 0) < 0)
+	{
+		fatal_error("prctl(PR_SET_THP_DISABLE) failed", -errno);
+	}
+	if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0)
+	{
+		fatal_error("--rt: mlockall failed; raise RLIMIT_MEMLOCK (ulimit -l) or grant CAP_IPC_LOCK", -errno);
+	}
+}
+
+// Report the cpufreq governor, idle states and isolation of the CPUs the workers run on, and where the devices'
+// interrupts go. Settings that make latency depend on host noise are flagged with a warning.
+static void check_rt_environment(const std::vector<int> &cpus, const std::vector<std::string> &devices)
+{
+	namespace fs = std::filesystem;
+	const fs::path cpu_dir = "/sys/devices/system/cpu";
+	int warnings = 0;
+	auto warn = [&](const std::string &msg)
+	{
+		std::cout << "  Warning: " << msg << "\n";
+		warnings++;
+	};
+	std::cout << "Environment (--rt), worker CPUs " << format_cpu_list(cpus) << ":\n";
+
+	std::map<std::string, std::vector<int>> governors;
+	std::vector<int> deep_idle;
+	int deepest_us = 0;
+	std::string deepest;
+	for (int cpu : cpus)
+	{
+		fs::path dir = cpu_dir / ("cpu" + std::to_string(cpu));
+		std::string governor = read_sysfs_line(dir / "cpufreq" / "scaling_governor");
+		governors[governor.empty() ? "none" : governor].push_back(cpu);
+
+		std::error_code ec;
+		bool deep = false;
+		for (const fs::directory_entry &state : fs::directory_iterator(dir / "cpuidle", ec))
+		{
+			int latency_us = atoi(read_sysfs_line(state.path() / "latency").c_str());
+			if (read_sysfs_line(state.path() / "disable") == "1" || latency_us <= RT_CSTATE_LATENCY_US)
+			{
+				continue;
+			}
+			deep = true;
+			if (latency_us > deepest_us)
+			{
+				deepest_us = latency_us;
+				deepest = read_sysfs_line(state.path() / "name");
+			}
+		}
+		if (deep)
+		{
+			deep_idle.push_back(cpu);
+		}
+	}
+	for (const auto &[governor, list] : governors)
+	{
+		std::cout << "  cpufreq:    " << governor << " on CPUs " << format_cpu_list(list) << "\n";
+		if (governor != "performance" && governor != "none")
+		{
+			warn("cpufreq governor '" + governor + "' changes clock speed under load; use 'performance'");
+		}
+	}
+	if (!deep_idle.empty())
+	{
+		warn("idle states up to " + deepest + " (" + std::to_string(deepest_us) + " us exit latency) enabled on CPUs " +
+		     format_cpu_list(deep_idle) + "; disable them, e.g. cpupower idle-set -D " +
+		     std::to_string(RT_CSTATE_LATENCY_US));
+	}
+	else
+	{
+		std::cout << "  C-states:   none deeper than " << RT_CSTATE_LATENCY_US << " us exit latency\n";
+	}
+
+	std::vector<int> isolated = parse_cpu_list(read_sysfs_line(cpu_dir / "isolated"));
+	std::vector<int> shared;
+	for (int cpu : cpus)
+	{
+		if (std::find(isolated.begin(), isolated.end(), cpu) == isolated.end())
+		{
+			shared.push_back(cpu);
+		}
+	}
+	std::cout << "  isolcpus:   " << (isolated.empty() ? "none" : format_cpu_list(isolated)) << ", nohz_full: "
+	          << [&] { std::string s = read_sysfs_line(cpu_dir / "nohz_full"); return s.empty() ? "none" : s; }()
+	          << "\n";
+	if (!shared.empty())
+	{
+		warn("CPUs " + format_cpu_list(shared) + " are not isolated (isolcpus=), so other tasks can run on them");
+	}
+
+	// MSI vectors of the PCI function behind each device, and the CPUs they are delivered to
+	for (const std::string &device : devices)
+	{
+		std::error_code ec;
+		fs::path pci = fs::canonical(sysfs_block_dir(device.c_str()) / "device" / "device", ec);
+		std::vector<int> irq_cpus;
+		int irqs = 0;
+		for (const fs::directory_entry &irq : fs::directory_iterator(pci / "msi_irqs", ec))
+		{
+			for (int cpu : parse_cpu_list(read_sysfs_line("/proc/irq/" + irq.path().filename().string() +
+			                                              "/effective_affinity_list")))
+			{
+				irq_cpus.push_back(cpu);
+			}
+			irqs++;
+		}
+		if (irqs == 0)
+		{
+			std::cout << "  IRQs:       " << device << ": no MSI interrupts found\n";
+			continue;
+		}
+		std::sort(irq_cpus.begin(), irq_cpus.end());
+		irq_cpus.erase(std::unique(irq_cpus.begin(), irq_cpus.end()), irq_cpus.end());
+		std::cout << "  IRQs:       " << device << ": " << irqs << " vectors on CPUs " << format_cpu_list(irq_cpus)
+		          << "\n";
+	}
+	std::error_code ec;
+	for (const fs::directory_entry &proc : fs::directory_iterator("/proc", ec))
+	{
+		if (read_sysfs_line(proc.path() / "comm") == "irqbalance")
+		{
+			warn("irqbalance is running and may move the device's interrupts during the run");
+			break;
+		}
+	}
+
+	if (warnings > 0)
+	{
+		std::cout << "  " << warnings << " setting(s) above can add latency noise\n";
+	}
+}
+
+static void *alloc_aligned_buffer(size_t size, size_t alignment)
+{
+	void *buf;
+	if (posix_memalign(&buf, alignment, size) != 0)
+	{
+		fatal_error("Failed to allocate aligned buffer");
+	}
+	return buf;
+}
+
+static std::mt19937_64 &thread_rng()
+{
+	static thread_local std::mt19937_64 rng(std::random_device {}());
+	return rng;
+}
+
+static uint64_t random_lba(uint64_t max_lba, uint64_t block_lbas)
+{
+	std::mt19937_64 &rng = thread_rng();
+
+	if (max_lba <= block_lbas)
+	{
+		return 0;
+	}
+	uint64_t max_start = max_lba - block_lbas;
+	std::uniform_int_distribution<uint64_t> dist(0, max_start);
+	return dist(rng);
+}
+
+// Write buffer content shaping. Buffers are built once at startup; the only per-I/O work is choosing between the
+// slot's own buffer and a shared dedupe buffer, plus one 8-byte store per chunk to keep unique writes unique.
+constexpr size_t CONTENT_CHUNK = 4096; // typical granularity of inline compression/dedupe engines
+constexpr int DEDUPE_BUFFERS = 8;      // shared contents repeated by dedupe writes
+
+// Fill each chunk with random bytes followed by compress_percentage% zeros
+static void build_buffer_content(void *buf, size_t len, int compress_percentage)
+{
+	std::mt19937_64 &rng = thread_rng();
+	uint8_t *p = (uint8_t *)buf;
+	for (size_t off = 0; off < len; off += CONTENT_CHUNK)
+	{
+		size_t chunk = std::min(CONTENT_CHUNK, len - off);
+		size_t random_bytes = chunk * (100 - compress_percentage) / 100;
+		for (size_t i = 0; i < random_bytes; i += sizeof(uint64_t))
+		{
+			uint64_t word = rng();
+			memcpy(p + off + i, &word, std::min(sizeof(word), random_bytes - i));
+		}
+		memset(p + off + random_bytes, 0, chunk - random_bytes);
+	}
+}
+
+// Make a slot buffer's content unique for this write without disturbing its compressibility
+static inline void stamp_unique_content(void *buf, size_t len, uint64_t sequence)
+{
+	for (size_t off = 0; off < len; off += CONTENT_CHUNK)
+	{
+		memcpy((uint8_t *)buf + off, &sequence, sizeof(sequence));
+	}
+}
+
+static inline bool random_chance(int percentage)
+{
+	return (int)(thread_rng()() % 100) < percentage;
+}
+
+// --record_offsets / --replay_offsets: the LBAs one worker issued in one phase, as LEB128 varints of the zigzag-coded
+// difference to the previous LBA. Sequential streams take a byte per I/O, random ones about five. The file is an
+// 8-byte magic followed by one OffsetLogHeader and its data per (phase, worker), in native byte order.
+constexpr char OFFSET_LOG_MAGIC[8] = {'R', 'I', 'O', 'O', 'F', 'F', 'S', '1'};
+
+struct OffsetLogHeader
+{
+	uint32_t phase;
+	uint32_t worker;
+	uint64_t count; // LBAs in the stream
+	uint64_t bytes; // encoded size
+};
+
+struct OffsetLog
+{
+	AppendLog<uint8_t> data;
+	uint64_t count = 0;
+	uint64_t last = 0;
+	size_t pos = 0; // replay position in data
+
+	void append(uint64_t lba)
+	{
+		uint64_t delta = lba - last;
+		uint64_t zigzag = (delta << 1) ^ (uint64_t)((int64_t)delta >> 63);
+		uint8_t bytes[10];
+		size_t n = 0;
+		while (zigzag >= 0x80)
+		{
+			bytes[n++] = (uint8_t)(zigzag | 0x80);
+			zigzag >>= 7;
+		}
+		bytes[n++] = (uint8_t)zigzag;
+		// A full log ends the stream rather than cutting an LBA in half
+		if (uint8_t *out = data.extend(n))
+		{
+			memcpy(out, bytes, n);
+			last = lba;
+			count++;
+		}
+	}
+
+	// False once the stream is exhausted
+	bool next(uint64_t *lba)
+	{
+		uint64_t zigzag = 0;
+		for (int shift = 0; pos < data.size(); shift += 7)
+		{
+			uint8_t byte = data[pos++];
+			zigzag |= (uint64_t)(byte & 0x7f) << shift;
+			if (!(byte & 0x80))
+			{
+				last += (zigzag >> 1) ^ (0 - (zigzag & 1));
+				*lba = last;
+				return true;
+			}
+		}
+		return false;
+	}
+};
+
+using OffsetLogs = std::map<std::pair<int, int>, OffsetLog>; // by (phase, worker id)
+
+static void write_offset_logs(const char *path, const OffsetLogs &logs)
+{
+	std::ofstream out(path, std::ios::binary | std::ios::trunc);
+	out.write(OFFSET_LOG_MAGIC, sizeof(OFFSET_LOG_MAGIC));
+	uint64_t total = 0;
+	for (const auto &[key, log] : logs)
+	{
+		OffsetLogHeader hdr = {(uint32_t)key.first, (uint32_t)key.second, log.count, log.data.size()};
+		out.write((const char *)&hdr, sizeof(hdr));
+		out.write((const char *)log.data.begin(), log.data.size());
+		total += log.count;
+	}
+	if (!out)
+	{
+		fatal_error("Failed to write --record_offsets file");
+	}
+	std::cout << "\nRecorded " << total << " offsets in " << logs.size() << " stream(s) to " << path << "\n";
+}
+
+static OffsetLogs read_offset_logs(const char *path)
+{
+	std::ifstream in(path, std::ios::binary);
+	char magic[sizeof(OFFSET_LOG_MAGIC)];
+	if (!in.read(magic, sizeof(magic)) || memcmp(magic, OFFSET_LOG_MAGIC, sizeof(magic)) != 0)
+	{
+		fatal_error("--replay_offsets: not a rio offset log");
+	}
+	OffsetLogs logs;
+	OffsetLogHeader hdr;
+	while (in.read((char *)&hdr, sizeof(hdr)))
+	{
+		OffsetLog &log = logs[{(int)hdr.phase, (int)hdr.worker}];
+		log.count = hdr.count;
+		log.data.reserve(hdr.bytes);
+		uint8_t *bytes = log.data.extend(hdr.bytes);
+		if (!bytes || !in.read((char *)bytes, hdr.bytes))
+		{
+			fatal_error("--replay_offsets: offset log is truncated");
+		}
+	}
+	return logs;
+}
+
+// Per-I/O event tracing. Each worker appends events to its own ring of large chunks; a background thread writes
+// full chunks to the trace file with O_DIRECT. If the writer falls behind, events are dropped and counted rather
+// than stalling the workload.
+constexpr size_t TRACE_CHUNK_EVENTS = 32768; // 768 KiB per write, a multiple of 4 KiB
+constexpr size_t TRACE_CHUNK_BYTES = TRACE_CHUNK_EVENTS * sizeof(TraceEvent);
+constexpr uint64_t TRACE_RING_CHUNKS = 16;
+
+struct TraceRing
+{
+	TraceEvent *events = nullptr;                 // TRACE_RING_CHUNKS chunks
+	alignas(64) std::atomic<uint64_t> produced {0}; // chunks published by the worker
+	alignas(64) std::atomic<uint64_t> consumed {0}; // chunks written out by the writer thread
+	alignas(64) size_t fill = 0;                    // events in the chunk being filled (worker-private)
+	uint64_t dropped = 0;                           // worker-private
+
+	void append(const TraceEvent &ev)
+	{
+		uint64_t chunk = produced.load(std::memory_order_relaxed);
+		if (fill == 0 && chunk - consumed.load(std::memory_order_acquire) == TRACE_RING_CHUNKS)
+		{
+			dropped++;
+			return;
+		}
+		events[(chunk % TRACE_RING_CHUNKS) * TRACE_CHUNK_EVENTS + fill] = ev;
+		if (++fill == TRACE_CHUNK_EVENTS)
+		{
+			fill = 0;
+			produced.store(chunk + 1, std::memory_order_release);
+		}
+	}
+};
+
+struct TraceWriter
+{
+	int fd = -1;
+	uint64_t offset = TRACE_HEADER_SIZE; // next write position
+	uint64_t events = 0;
+	TraceHeader header = {};
+	std::vector<TraceRing *> rings;
+	std::atomic<bool> stop {false};
+	std::thread thread;
+};
+
+// Write all published chunks; returns whether anything was written
+static bool drain_trace_rings(TraceWriter *tw)
+{
+	bool wrote = false;
+	for (TraceRing *ring : tw->rings)
+	{
+		uint64_t done = ring->consumed.load(std::memory_order_relaxed);
+		while (done < ring->produced.load(std::memory_order_acquire))
+		{
+			const TraceEvent *chunk = ring->events + (done % TRACE_RING_CHUNKS) * TRACE_CHUNK_EVENTS;
+			if (pwrite(tw->fd, chunk, TRACE_CHUNK_BYTES, tw->offset) != (ssize_t)TRACE_CHUNK_BYTES)
+			{
+				fatal_error("Failed to write trace", -errno);
+			}
+			tw->offset += TRACE_CHUNK_BYTES;
+			tw->events += TRACE_CHUNK_EVENTS;
+			ring->consumed.store(++done, std::memory_order_release);
+			wrote = true;
+		}
+	}
+	return wrote;
+}
+
+static void trace_writer_loop(TraceWriter *tw)
+{
+	while (!tw->stop.load(std::memory_order_acquire))
+	{
+		if (!drain_trace_rings(tw))
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	}
+	drain_trace_rings(tw);
+}
+
+static TraceRing *alloc_trace_ring()
+{
+	TraceRing *ring = new TraceRing;
+	ring->events = (TraceEvent *)alloc_aligned_buffer(TRACE_RING_CHUNKS * TRACE_CHUNK_BYTES, 4096);
+	return ring;
+}
+
+static void start_trace_writer(TraceWriter *tw, const char *path, uint32_t lba_size)
+{
+	tw->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC | O_DIRECT, 0644);
+	if (tw->fd < 0 && errno == EINVAL)
+	{
+		// Filesystems such as tmpfs reject O_DIRECT
+		tw->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	}
+	if (tw->fd < 0)
+	{
+		fatal_error("Failed to open trace file", -errno);
+	}
+
+	memcpy(tw->header.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC));
+	tw->header.version = TRACE_VERSION;
+	tw->header.event_size = sizeof(TraceEvent);
+	tw->header.lba_size = lba_size;
+	tw->header.workers = tw->rings.size();
+	tw->header.start_unix_ns =
+	    std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch())
+	        .count();
+	tw->thread = std::thread(trace_writer_loop, tw);
+}
+
+// Stop the writer, flush the partially filled chunks and finalize the header. Workers must have stopped appending.
+static void stop_trace_writer(TraceWriter *tw)
+{
+	tw->stop.store(true, std::memory_order_release);
+	tw->thread.join();
+
+	// Partial chunks land at unaligned offsets, so finish the file in buffered mode
+	int flags = fcntl(tw->fd, F_GETFL);
+	fcntl(tw->fd, F_SETFL, flags & ~O_DIRECT);
+
+	for (TraceRing *ring : tw->rings)
+	{
+		tw->header.dropped += ring->dropped;
+		const TraceEvent *chunk =
+		    ring->events + (ring->produced.load(std::memory_order_relaxed) % TRACE_RING_CHUNKS) * TRACE_CHUNK_EVENTS;
+		size_t bytes = ring->fill * sizeof(TraceEvent);
+		if (bytes > 0 && pwrite(tw->fd, chunk, bytes, tw->offset) != (ssize_t)bytes)
+		{
+			fatal_error("Failed to write trace", -errno);
+		}
+		tw->offset += bytes;
+		tw->events += ring->fill;
+	}
+
+	tw->header.events = tw->events;
+	if (pwrite(tw->fd, &tw->header, sizeof(tw->header), 0) != (ssize_t)sizeof(tw->header))
+	{
+		fatal_error("Failed to write trace header", -errno);
+	}
+	close(tw->fd);
+
+	std::cout << "\nTrace: " << tw->events << " events written";
+	if (tw->header.dropped > 0)
+	{
+		std::cout << ", " << tw->header.dropped << " dropped (writer fell behind)";
+	}
+	std::cout << "\n";
+}
+
+static void submit_read_direct(struct io_uring *ring, int fixed_fd_idx, void *buf, size_t size, uint64_t offset,
+                               int buf_index, int slot, uint16_t ioprio)
+{
+	struct io_uring_sqe *sqe = get_sqe(ring);
+	io_uring_prep_read_fixed(sqe, fixed_fd_idx, buf, size, offset, buf_index);
+	sqe->flags |= IOSQE_FIXED_FILE;
+	sqe->ioprio = ioprio;
+	io_uring_sqe_set_data(sqe, (void *)(uintptr_t)slot);
+}
+
+static void submit_write_direct(struct io_uring *ring, int fixed_fd_idx, void *buf, size_t size, uint64_t offset,
+                                int buf_index, int slot, uint16_t ioprio)
+{
+	struct io_uring_sqe *sqe = get_sqe(ring);
+	io_uring_prep_write_fixed(sqe, fixed_fd_idx, buf, size, offset, buf_index);
+	sqe->flags |= IOSQE_FIXED_FILE;
+	sqe->ioprio = ioprio;
+	io_uring_sqe_set_data(sqe, (void *)(uintptr_t)slot);
+}
+
+static double percentile(std::vector<double> &sorted_latencies, double p)
+{
+	if (sorted_latencies.empty())
+		return 0.0;
+	double index = (p / 100.0) * (sorted_latencies.size() - 1);
+	size_t lower = (size_t)index;
+	size_t upper = lower + 1;
+	if (upper >= sorted_latencies.size())
+		return sorted_latencies.back();
+	double frac = index - lower;
+	return sorted_latencies[lower] * (1 - frac) + sorted_latencies[upper] * frac;
+}
+
+// Headline results of a job, printed after it runs and collected into the --sweep table
+struct Metrics
+{
+	double iops;
+	double bandwidth_mbs;
+	double avg_lat, min_lat, p50, p95, p99, max_lat; // us
+};
+
+static Metrics compute_metrics(const std::vector<double> &latencies, double elapsed_sec, uint64_t completed_ops,
+                               size_t block_size)
+{
+	Metrics m;
+	m.iops = completed_ops / elapsed_sec;
+	m.bandwidth_mbs = (completed_ops * block_size) / (elapsed_sec * 1024 * 1024);
+
+	// Calculate latency statistics
+	std::vector<double> sorted_lat = latencies;
+	std::sort(sorted_lat.begin(), sorted_lat.end());
+
+	m.avg_lat = 0.0;
+	if (!latencies.empty())
+	{
+		m.avg_lat = std::accumulate(latencies.begin(), latencies.end(), 0.0) / latencies.size();
+	}
+
+	m.p50 = percentile(sorted_lat, 50.0);
+	m.p95 = percentile(sorted_lat, 95.0);
+	m.p99 = percentile(sorted_lat, 99.0);
+	m.min_lat = sorted_lat.empty() ? 0.0 : sorted_lat.front();
+	m.max_lat = sorted_lat.empty() ? 0.0 : sorted_lat.back();
+	return m;
+}
+
+static void print_metrics(const Metrics &m)
+{
+	std::cout << "\n";
+	std::cout << "Results:\n";
+	std::cout << "  IOPS:       " << std::fixed << std::setprecision(0) << m.iops << "\n";
+	std::cout << "  Bandwidth:  " << std::fixed << std::setprecision(2) << m.bandwidth_mbs << " MB/s\n";
+	std::cout << "  Latency (us):\n";
+	std::cout << "    avg:      " << std::fixed << std::setprecision(2) << m.avg_lat << "\n";
+	std::cout << "    min:      " << std::fixed << std::setprecision(2) << m.min_lat << "\n";
+	std::cout << "    p50:      " << std::fixed << std::setprecision(2) << m.p50 << "\n";
+	std::cout << "    p95:      " << std::fixed << std::setprecision(2) << m.p95 << "\n";
+	std::cout << "    p99:      " << std::fixed << std::setprecision(2) << m.p99 << "\n";
+	std::cout << "    max:      " << std::fixed << std::setprecision(2) << m.max_lat << "\n";
+}
+
+// --prio: latency of the I/Os issued with the job's priority next to those left at the default
+static void print_class_latencies(uint16_t ioprio, std::vector<double> class_latencies[2])
+{
+	size_t total = class_latencies[0].size() + class_latencies[1].size();
+	std::cout << "\nLatency by priority class (us):\n";
+	for (int c = 1; c >= 0; c--)
+	{
+		std::vector<double> &lat = class_latencies[c];
+		if (lat.empty())
+			continue;
+		std::sort(lat.begin(), lat.end());
+		double avg = std::accumulate(lat.begin(), lat.end(), 0.0) / lat.size();
+		std::cout << "  " << std::left << std::setw(9) << (c ? describe_ioprio(ioprio) : "default") << std::right
+		          << " ios " << lat.size() << " (" << std::fixed << std::setprecision(1) << 100.0 * lat.size() / total
+		          << "%)" << std::setprecision(2) << ", avg " << avg << ", p50 " << percentile(lat, 50.0) << ", p99 "
+		          << percentile(lat, 99.0) << ", max " << lat.back() << "\n";
+	}
+}
+
+// --isolation: each job's results alone (phase j) against the shared run (the last phase)
+static void print_isolation_table(const std::vector<std::vector<Metrics>> &results, const std::vector<Config> &jobs)
+{
+	int job_width = 5;
+	for (const Config &job : jobs)
+	{
+		job_width = std::max(job_width, (int)strlen(job.name) + 2);
+	}
+
+	std::cout << "\nIsolation (each job alone vs. all jobs together):\n";
+	std::cout << std::setw(job_width) << "job" << std::setw(12) << "solo iops" << std::setw(13) << "shared iops"
+	          << std::setw(14) << "solo p99(us)" << std::setw(16) << "shared p99(us)" << std::setw(14) << "p99 change"
+	          << "\n";
+	const std::vector<Metrics> &shared = results.back();
+	for (size_t j = 0; j < jobs.size(); j++)
+	{
+		const Metrics &solo = results[j][j];
+		double change = solo.p99 > 0 ? 100.0 * (shared[j].p99 / solo.p99 - 1) : 0.0;
+		std::cout << std::setw(job_width) << jobs[j].name << std::fixed << std::setprecision(0) << std::setw(12)
+		          << solo.iops << std::setw(13) << shared[j].iops << std::setprecision(2) << std::setw(14) << solo.p99
+		          << std::setw(16) << shared[j].p99 << std::setprecision(1) << std::setw(13) << std::showpos
+		          << change << std::noshowpos << "%\n";
+	}
+}
+
+// --sweep: one row per point and job, with the swept values as the leading columns
+static void print_sweep_table(const Scenario &scenario, const std::vector<std::vector<Metrics>> &results,
+                              const std::vector<Config> &jobs, bool named)
+{
+	std::vector<int> widths;
+	for (const SweepAxis &axis : scenario.sweep)
+	{
+		size_t width = strlen(axis.opt->name);
+		for (const char *value : axis.values)
+		{
+			width = std::max(width, strlen(value));
+		}
+		widths.push_back((int)width + 2);
+	}
+	int job_width = 5;
+	for (size_t j = 0; named && j < jobs.size(); j++)
+	{
+		job_width = std::max(job_width, (int)strlen(jobs[j].name) + 2);
+	}
+
+	std::cout << "\nSweep results:\n";
+	for (size_t a = 0; a < scenario.sweep.size(); a++)
+	{
+		std::cout << std::setw(widths[a]) << scenario.sweep[a].opt->name;
+	}
+	if (named)
+	{
+		std::cout << std::setw(job_width) << "job";
+	}
+	std::cout << std::setw(12) << "iops" << std::setw(12) << "MB/s" << std::setw(12) << "avg(us)" << std::setw(12)
+	          << "p50(us)" << std::setw(12) << "p99(us)" << std::setw(12) << "max(us)" << "\n";
+
+	for (size_t p = 0; p < results.size(); p++)
+	{
+		for (size_t j = 0; j < results[p].size(); j++)
+		{
+			const Metrics &m = results[p][j];
+			for (size_t a = 0; a < scenario.sweep.size(); a++)
+			{
+				std::cout << std::setw(widths[a]) << scenario.phases[p].point[a];
+			}
+			if (named)
+			{
+				std::cout << std::setw(job_width) << jobs[j].name;
+			}
+			std::cout << std::fixed << std::setprecision(0) << std::setw(12) << m.iops << std::setprecision(2)
+			          << std::setw(12) << m.bandwidth_mbs << std::setw(12) << m.avg_lat << std::setw(12) << m.p50
+			          << std::setw(12) << m.p99 << std::setw(12) << m.max_lat << "\n";
+		}
+	}
+}
+
+// One exporter source per worker. Sources of the same job are contiguous and are summed into one series per job.
+struct MetricsSource
+{
+	const Config *job;
+	const LiveStats *stats;
+};
+
+struct MetricsExporter
+{
+	const Config *cfg = nullptr;
+	std::vector<MetricsSource> sources;
+	std::atomic<bool> stop {false};
+	std::thread thread;
+	int listen_fd = -1;
+};
+
+// Render all sources as one OpenMetrics exposition. Histogram buckets are emitted at power-of-two nanosecond bounds
+// from ~1us to ~68s, which keeps the exposition small while preserving the log-linear shape.
+static std::string render_openmetrics(const MetricsExporter *exp)
+{
+	struct JobTotals
+	{
+		std::string labels;
+		uint64_t ops = 0, bytes = 0, latency_ns_sum = 0, errors = 0;
+		std::vector<uint64_t> hist = std::vector<uint64_t>(HIST_BUCKETS, 0);
+	};
+	std::vector<JobTotals> totals;
+	const Config *last_job = nullptr;
+	for (const MetricsSource &src : exp->sources)
+	{
+		if (src.job != last_job)
+		{
+			char labels[512];
+			snprintf(labels, sizeof(labels), "%s%s%sdevice=\"%s\",type=\"%s\",mode=\"%s\"",
+			         src.job->name ? "job_name=\"" : "", src.job->name ? src.job->name : "", src.job->name ? "\"," : "",
+			         src.job->filename, src.job->type, src.job->passthrough ? "passthrough" : "direct");
+			totals.emplace_back();
+			totals.back().labels = labels;
+			last_job = src.job;
+		}
+		JobTotals &t = totals.back();
+		t.ops += src.stats->ops.load(std::memory_order_relaxed);
+		t.bytes += src.stats->bytes.load(std::memory_order_relaxed);
+		t.latency_ns_sum += src.stats->latency_ns_sum.load(std::memory_order_relaxed);
+		t.errors += src.stats->errors.load(std::memory_order_relaxed);
+		for (int i = 0; i < HIST_BUCKETS; i++)
+		{
+			t.hist[i] += src.stats->hist[i].load(std::memory_order_relaxed);
+		}
+	}
+
+	std::string out;
+	char line[2048];
+	out += "# TYPE rio_ops counter\n"
+	       "# HELP rio_ops Completed I/O operations.\n";
+	for (const JobTotals &t : totals)
+	{
+		snprintf(line, sizeof(line), "rio_ops_total{%s} %lu\n", t.labels.c_str(), t.ops);
+		out += line;
+	}
+	out += "# TYPE rio_bytes counter\n"
+	       "# UNIT rio_bytes bytes\n"
+	       "# HELP rio_bytes Bytes transferred by completed I/O operations.\n";
+	for (const JobTotals &t : totals)
+	{
+		snprintf(line, sizeof(line), "rio_bytes_total{%s} %lu\n", t.labels.c_str(), t.bytes);
+		out += line;
+	}
+	out += "# TYPE rio_errors counter\n"
+	       "# HELP rio_errors Failed I/O attempts, including retried ones.\n";
+	for (const JobTotals &t : totals)
+	{
+		snprintf(line, sizeof(line), "rio_errors_total{%s} %lu\n", t.labels.c_str(), t.errors);
+		out += line;
+	}
+	out += "# TYPE rio_latency_seconds histogram\n"
+	       "# UNIT rio_latency_seconds seconds\n"
+	       "# HELP rio_latency_seconds I/O completion latency.\n";
+	for (const JobTotals &t : totals)
+	{
+		const char *labels = t.labels.c_str();
+
+		// Derive the count from the buckets so that +Inf and _count always agree, even on a torn snapshot
+		uint64_t cumulative = 0;
+		int idx = 0;
+		for (int bound_shift = 10; bound_shift <= 36; bound_shift++)
+		{
+			uint64_t bound_ns = 1ULL << bound_shift;
+			while (idx < HIST_BUCKETS && hist_bucket_upper(idx) <= bound_ns)
+			{
+				cumulative += t.hist[idx++];
+			}
+			snprintf(line, sizeof(line), "rio_latency_seconds_bucket{%s,le=\"%.9g\"} %lu\n", labels, bound_ns / 1e9,
+			         cumulative);
+			out += line;
+		}
+		while (idx < HIST_BUCKETS)
+		{
+			cumulative += t.hist[idx++];
+		}
+		snprintf(line, sizeof(line),
+		         "rio_latency_seconds_bucket{%s,le=\"+Inf\"} %lu\n"
+		         "rio_latency_seconds_count{%s} %lu\n"
+		         "rio_latency_seconds_sum{%s} %.9f\n",
+		         labels, cumulative, labels, cumulative, labels, t.latency_ns_sum / 1e9);
+		out += line;
+	}
+	out += "# EOF\n";
+	return out;
+}
+
+static bool write_all(int fd, const char *data, size_t len)
+{
+	while (len > 0)
+	{
+		ssize_t n = write(fd, data, len);
+		if (n < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+		data += n;
+		len -= n;
+	}
+	return true;
+}
+
+// Write to a temporary file and rename over the target so scrapers never see a partial file
+static void write_metrics_file(const char *path, const std::string &text)
+{
+	std::string tmp = std::string(path) + ".tmp";
+	int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0)
+	{
+		std::cerr << "Warning: Failed to open " << tmp << ": " << strerror(errno) << std::endl;
+		return;
+	}
+	bool ok = write_all(fd, text.data(), text.size());
+	close(fd);
+	if (!ok || rename(tmp.c_str(), path) < 0)
+	{
+		std::cerr << "Warning: Failed to write " << path << ": " << strerror(errno) << std::endl;
+		unlink(tmp.c_str());
+	}
+}
+
+static int open_metrics_socket(const char *path)
+{
+	struct sockaddr_un addr = {};
+	addr.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(addr.sun_path))
+	{
+		fatal_error("Metrics socket path too long");
+	}
+	strcpy(addr.sun_path, path);
+
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+	{
+		fatal_error("Failed to create metrics socket", -errno);
+	}
+	unlink(path);
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 8) < 0)
+	{
+		fatal_error("Failed to bind metrics socket", -errno);
+	}
+	return fd;
+}
+
+// Answer one scrape. The request itself is ignored beyond draining it; a minimal HTTP response lets both
+// `curl --unix-socket` and plain `socat` readers consume the exposition.
+static void serve_metrics_client(int listen_fd, const MetricsExporter *exp)
+{
+	int fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+	if (fd < 0)
+		return;
+
+	struct pollfd pfd = {.fd = fd, .events = POLLIN, .revents = 0};
+	char req[1024];
+	if (poll(&pfd, 1, 100) > 0)
+	{
+		(void)!read(fd, req, sizeof(req));
+	}
+
+	std::string body = render_openmetrics(exp);
+	char header[256];
+	int len = snprintf(header, sizeof(header),
+	                   "HTTP/1.0 200 OK\r\n"
+	                   "Content-Type: application/openmetrics-text; version=1.0.0; charset=utf-8\r\n"
+	                   "Content-Length: %zu\r\n\r\n",
+	                   body.size());
+	if (write_all(fd, header, len))
+	{
+		write_all(fd, body.data(), body.size());
+	}
+	close(fd);
+}
+
+static void metrics_exporter_loop(MetricsExporter *exp)
+{
+	const auto interval = std::chrono::seconds(exp->cfg->metrics_interval);
+	TimePoint next_write = Clock::now();
+
+	while (!exp->stop.load(std::memory_order_relaxed))
+	{
+		if (exp->cfg->metrics_file && Clock::now() >= next_write)
+		{
+			write_metrics_file(exp->cfg->metrics_file, render_openmetrics(exp));
+			next_write += interval;
+		}
+
+		// Wake at least every 100ms to notice stop requests
+		if (exp->listen_fd >= 0)
+		{
+			struct pollfd pfd = {.fd = exp->listen_fd, .events = POLLIN, .revents = 0};
+			if (poll(&pfd, 1, 100) > 0)
+			{
+				serve_metrics_client(exp->listen_fd, exp);
+			}
+		}
+		else
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		}
+	}
+
+	// Final snapshot so the file reflects the complete run
+	if (exp->cfg->metrics_file)
+	{
+		write_metrics_file(exp->cfg->metrics_file, render_openmetrics(exp));
+	}
+}
+
+static void start_metrics_exporter(MetricsExporter *exp, const Config *cfg)
+{
+	exp->cfg = cfg;
+	if (cfg->metrics_socket)
+	{
+		exp->listen_fd = open_metrics_socket(cfg->metrics_socket);
+	}
+	exp->thread = std::thread(metrics_exporter_loop, exp);
+}
+
+static void stop_metrics_exporter(MetricsExporter *exp)
+{
+	exp->stop.store(true, std::memory_order_relaxed);
+	exp->thread.join();
+	if (exp->listen_fd >= 0)
+	{
+		close(exp->listen_fd);
+		unlink(exp->cfg->metrics_socket);
+	}
+}
+
+static void submit_read_passthrough(struct io_uring *ring, NVMeDevice *nvme, int fixed_fd_idx, void *buf, uint64_t lba,
+                                    uint32_t blocks, int buf_index)
+{
+	struct io_uring_sqe *sqe = get_sqe(ring);
+
+	// Prepare NVMe uring command (different from nvme_passthru_cmd)
+	struct nvme_uring_cmd cmd = {};
+	cmd.opcode = nvme_cmd_read;
+	cmd.nsid = nvme->nsid;
+	cmd.addr = (uint64_t)buf;
+	cmd.data_len = blocks * nvme->lba_size;
+	cmd.cdw10 = (uint32_t)lba;         // starting LBA lower 32 bits
+	cmd.cdw11 = (uint32_t)(lba >> 32); // starting LBA upper 32 bits
+	cmd.cdw12 = blocks - 1;            // number of blocks (0-based)
+
+	// Setup IORING_OP_URING_CMD for NVMe passthrough
+	sqe->opcode = IORING_OP_URING_CMD;
+	sqe->fd = fixed_fd_idx;
+	sqe->cmd_op = NVME_URING_CMD_IO;
+	sqe->flags |= IOSQE_FIXED_FILE;
+	memcpy(sqe->cmd, &cmd, sizeof(cmd));
+	io_uring_sqe_set_data(sqe, (void *)(uintptr_t)buf_index);
+}
+
+static void submit_write_passthrough(struct io_uring *ring, NVMeDevice *nvme, int fixed_fd_idx, void *buf, uint64_t lba,
+                                     uint32_t blocks, int buf_index)
+{
+	struct io_uring_sqe *sqe = get_sqe(ring);
+
+	struct nvme_uring_cmd cmd = {};
+	cmd.opcode = nvme_cmd_write;
+	cmd.nsid = nvme->nsid;
+	cmd.addr = (uint64_t)buf;
+	cmd.data_len = blocks * nvme->lba_size;
+	cmd.cdw10 = (uint32_t)lba;         // starting LBA lower 32 bits
+	cmd.cdw11 = (uint32_t)(lba >> 32); // starting LBA upper 32 bits
+	cmd.cdw12 = blocks - 1;            // number of blocks (0-based)
+
+	sqe->opcode = IORING_OP_URING_CMD;
+	sqe->fd = fixed_fd_idx;
+	sqe->cmd_op = NVME_URING_CMD_IO;
+	sqe->flags |= IOSQE_FIXED_FILE;
+	memcpy(sqe->cmd, &cmd, sizeof(cmd));
+	io_uring_sqe_set_data(sqe, (void *)(uintptr_t)buf_index);
+}
+
+// Queue one read or write for an I/O slot in the configured mode, for I/O that does not match the slot's template
+// (the read-back pass of verified writes). reg_idx is the registered buffer backing `buf`,
+// which is the slot's own buffer except for writes drawn from the shared dedupe buffers.
+static void submit_io(struct io_uring *ring, NVMeDevice *nvme, int fixed_fd_idx, bool passthrough, bool is_write,
+                      void *buf, int reg_idx, uint64_t lba, uint64_t block_lbas, int buf_idx, uint16_t ioprio)
+{
+	if (passthrough)
+	{
+		if (is_write)
+			submit_write_passthrough(ring, nvme, fixed_fd_idx, buf, lba, block_lbas, buf_idx);
+		else
+			submit_read_passthrough(ring, nvme, fixed_fd_idx, buf, lba, block_lbas, buf_idx);
+	}
+	else
+	{
+		uint64_t offset = lba * nvme->lba_size;
+		size_t size = block_lbas * nvme->lba_size;
+		if (is_write)
+			submit_write_direct(ring, fixed_fd_idx, buf, size, offset, reg_idx, buf_idx, ioprio);
+		else
+			submit_read_direct(ring, fixed_fd_idx, buf, size, offset, reg_idx, buf_idx, ioprio);
+	}
+}
+
+// Hot-path submission from per-slot SQE templates. What stays fixed for a slot during a phase (opcode, target,
+// buffer, NVMe command header, user_data) is written once per phase; a submit copies the slot's template into the SQ
+// and patches only the LBA, the length and the priority.
+constexpr size_t SQE_TEMPLATE_STRIDE = 128; // room for a passthrough SQE128
+
+static void build_sqe_template(struct io_uring_sqe *sqe, const NVMeDevice &nvme, int fixed_fd_idx, bool passthrough,
+                               bool is_write, void *buf, int reg_idx, int slot)
+{
+	memset(sqe, 0, SQE_TEMPLATE_STRIDE);
+	if (passthrough)
+	{
+		struct nvme_uring_cmd *cmd = (struct nvme_uring_cmd *)sqe->cmd;
+		cmd->opcode = is_write ? nvme_cmd_write : nvme_cmd_read;
+		cmd->nsid = nvme.nsid;
+		cmd->addr = (uint64_t)buf;
+		sqe->opcode = IORING_OP_URING_CMD;
+		sqe->fd = fixed_fd_idx;
+		sqe->cmd_op = NVME_URING_CMD_IO;
+	}
+	else if (is_write)
+	{
+		io_uring_prep_write_fixed(sqe, fixed_fd_idx, buf, 0, 0, reg_idx);
+	}
+	else
+	{
+		io_uring_prep_read_fixed(sqe, fixed_fd_idx, buf, 0, 0, reg_idx);
+	}
+	sqe->flags |= IOSQE_FIXED_FILE;
+	io_uring_sqe_set_data(sqe, (void *)(uintptr_t)slot);
+}
+
+// Queue a slot's I/O from its template. buf only differs from the template's buffer for dedupe writes, which then
+// also pass their registered buffer index.
+static inline void submit_slot(struct io_uring *ring, const struct io_uring_sqe *tmpl, bool passthrough, void *buf,
+                               int reg_idx, uint64_t lba, uint32_t blocks, uint32_t lba_size, uint16_t ioprio)
+{
+	struct io_uring_sqe *sqe = get_sqe(ring);
+	if (passthrough)
+	{
+		memcpy(sqe, tmpl, SQE_TEMPLATE_STRIDE);
+		struct nvme_uring_cmd *cmd = (struct nvme_uring_cmd *)sqe->cmd;
+		cmd->addr = (uint64_t)buf;
+		cmd->data_len = blocks * lba_size;
+		cmd->cdw10 = (uint32_t)lba;         // starting LBA lower 32 bits
+		cmd->cdw11 = (uint32_t)(lba >> 32); // starting LBA upper 32 bits
+		cmd->cdw12 = blocks - 1;            // number of blocks (0-based)
+	}
+	else
+	{
+		memcpy(sqe, tmpl, sizeof(*sqe));
+		if (buf != (void *)(uintptr_t)sqe->addr)
+		{
+			sqe->addr = (uint64_t)buf;
+			sqe->buf_index = reg_idx;
+		}
+		sqe->off = lba * lba_size;
+		sqe->len = blocks * lba_size;
+		sqe->ioprio = ioprio;
+	}
+}
+
+// --offset, --io_range and --offset_increment: the LBAs worker k of a job may touch
+static void worker_region(const Config &cfg, const NVMeDevice &nvme, int k, uint64_t *base, uint64_t *count)
+{
+	*base = (cfg.offset + k * cfg.offset_increment) / nvme.lba_size;
+	*count = cfg.io_range ? cfg.io_range / nvme.lba_size : nvme.nlba - std::min(*base, nvme.nlba);
+}
+
+// LBA each slot is writing in verify mode: an open-addressing table at most half full, with linear probing and
+// backward-shift deletion, so checking an LBA costs the same at any queue depth
+struct InFlightLBAs
+{
+	static constexpr uint64_t EMPTY = UINT64_MAX;
+	struct Entry
+	{
+		uint64_t lba;
+		int slot;
+	};
+	std::vector<Entry> table;
+	size_t mask = 0;
+
+	void init(int slots)
+	{
+		table.assign(std::bit_ceil((size_t)slots * 2), Entry {EMPTY, -1});
+		mask = table.size() - 1;
+	}
+
+	size_t find(uint64_t lba) const
+	{
+		size_t i = (lba * 0x9e3779b97f4a7c15ULL >> 32) & mask;
+		while (table[i].lba != EMPTY && table[i].lba != lba)
+		{
+			i = (i + 1) & mask;
+		}
+		return i;
+	}
+
+	bool contains(uint64_t lba) const
+	{
+		return table[find(lba)].lba != EMPTY;
+	}
+
+	void insert(uint64_t lba, int slot)
+	{
+		table[find(lba)] = {lba, slot};
+	}
+
+	// Remove the slot's entry, if the LBA is still recorded for that slot
+	void erase(uint64_t lba, int slot)
+	{
+		size_t hole = find(lba);
+		if (table[hole].lba == EMPTY || table[hole].slot != slot)
+		{
+			return;
+		}
+		for (size_t i = (hole + 1) & mask; table[i].lba != EMPTY; i = (i + 1) & mask)
+		{
+			size_t home = (table[i].lba * 0x9e3779b97f4a7c15ULL >> 32) & mask;
+			// Move the entry into the hole unless its home lies cyclically in (hole, i]
+			if (((i - home) & mask) >= ((i - hole) & mask))
+			{
+				table[hole] = table[i];
+				hole = i;
+			}
+		}
+		table[hole] = {EMPTY, -1};
+	}
+};
+
+// Verify mode writes use block-aligned LBAs and never overlap a write still in flight, so the newest generation
+// logged for a block is the one that must be on media. Each worker of a job writes its own slice of the device,
+// which holds at least one block per slot.
+static uint64_t verify_write_lba(InFlightLBAs *in_flight, int buf_idx, uint64_t old_lba, uint64_t lba_base,
+                                 uint64_t lba_count, uint64_t block_lbas)
+{
+	in_flight->erase(old_lba, buf_idx);
+	for (;;)
+	{
+		uint64_t lba = lba_base + random_lba(lba_count / block_lbas, 1) * block_lbas;
+		if (!in_flight->contains(lba))
+		{
+			in_flight->insert(lba, buf_idx);
+			return lba;
+		}
+	}
+}
+
+// Read back the newest generation of every block written during the workload and check its headers
+static void run_verify_pass(struct io_uring *ring, NVMeDevice *nvme, const Config &cfg, int fixed_fd_idx,
+                            IOContext *io_contexts, AppendLog<WrittenBlock> &written, VerifyStats *stats)
+{
+	std::sort(written.begin(), written.end(), [](const WrittenBlock &a, const WrittenBlock &b)
+	          { return a.lba != b.lba ? a.lba < b.lba : a.generation > b.generation; });
+	written.truncate(std::unique(written.begin(), written.end(),
+	                             [](const WrittenBlock &a, const WrittenBlock &b) { return a.lba == b.lba; }) -
+	                 written.begin());
+
+	uint64_t block_lbas = cfg.block_size / nvme->lba_size;
+	size_t next = 0;
+	int in_flight = 0;
+
+	auto queue_next = [&](int buf_idx)
+	{
+		io_contexts[buf_idx].lba = written[next].lba;
+		io_contexts[buf_idx].generation = written[next].generation;
+		submit_io(ring, nvme, fixed_fd_idx, cfg.passthrough, false, io_contexts[buf_idx].buffer, buf_idx,
+		          written[next].lba, block_lbas, buf_idx, 0);
+		next++;
+		in_flight++;
+	};
+
+	for (int i = 0; i < cfg.iodepth && next < written.size(); i++)
+	{
+		queue_next(i);
+	}
+
+	while (in_flight > 0)
+	{
+		int ret = io_uring_submit_and_wait(ring, 1);
+		if (ret < 0)
+		{
+			fatal_error("io_uring wait failed", ret);
+		}
+
+		struct io_uring_cqe *cqe;
+		unsigned head;
+		unsigned count = 0;
+		io_uring_for_each_cqe(ring, head, cqe)
+		{
+			int status = io_status(cqe, cfg.passthrough);
+			if (status != 0)
+			{
+				fatal_error(("Verify read failed: " + describe_io_status(status)).c_str());
+			}
+			int buf_idx = (int)(uintptr_t)io_uring_cqe_get_data(cqe);
+			const IOContext *ctx = &io_contexts[buf_idx];
+			check_verify_headers(ctx->buffer, ctx->lba, block_lbas, nvme->lba_size, cfg.verify_seed, ctx->generation,
+			                     stats);
+			in_flight--;
+			count++;
+
+			if (next < written.size())
+			{
+				queue_next(buf_idx);
+			}
+		}
+		io_uring_cq_advance(ring, count);
+	}
+}
+
+static bool is_write_type(const char *type)
+{
+	return strcmp(type, "randwrite") == 0 || strcmp(type, "write") == 0;
+}
+
+static bool is_sequential_type(const char *type)
+{
+	return strcmp(type, "read") == 0 || strcmp(type, "write") == 0;
+}
+
+// Rendezvous point for worker threads, reusable across phases. The thread completing a generation stamps the time,
+// so everyone released together shares one start time.
+struct StartBarrier
+{
+	std::mutex lock;
+	std::condition_variable cv;
+	int expected = 0;
+	int arrived = 0;
+	uint64_t generation = 0;
+	TimePoint start_time;
+	std::function<void()> before_release; // run by the last thread to arrive, before anyone is released
+
+	TimePoint wait()
+	{
+		std::unique_lock<std::mutex> guard(lock);
+		uint64_t gen = generation;
+		if (++arrived == expected)
+		{
+			if (before_release)
+			{
+				before_release();
+			}
+			arrived = 0;
+			generation++;
+			start_time = Clock::now();
+			cv.notify_all();
+		}
+		else
+		{
+			cv.wait(guard, [&] { return generation != gen; });
+		}
+		return start_time;
+	}
+};
+
+// --sync: the same kind of rendezvous across rio processes, for instance one per container, through a POSIX shared
+// memory object (/dev/shm/rio-<name>, which the processes must share). Each process arrives once all its workers
+// are set up; the last one to arrive releases the others, which are polling, so every process starts its phase
+// within a few tens of microseconds.
+//
+// The object is private to the user (0600). Every live process holds a read lock on it; a process that can take
+// the write lock instead is alone with the object, which it then resets, so an object left behind by a run that
+// died is never joined.
+constexpr uint32_t SYNC_MAGIC = 0x72696f53; // "rioS": the object was initialized
+
+struct SyncArea
+{
+	std::atomic<uint32_t> magic;
+	std::atomic<uint32_t> processes; // --sync count of the process that initialized the object
+	std::atomic<uint32_t> arrived;
+	std::atomic<uint32_t> generation;
+	std::atomic<uint32_t> finished; // processes that ran all their phases
+};
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "SyncArea must be usable across processes");
+
+struct ProcessRendezvous
+{
+	std::string shm_name;
+	uint32_t processes = 0;
+	int fd = -1; // kept open for the lock
+	SyncArea *area = nullptr;
+
+	static bool lock(int fd, short type, bool wait)
+	{
+		struct flock lk = {};
+		lk.l_type = type;
+		lk.l_whence = SEEK_SET;
+		return fcntl(fd, wait ? F_SETLKW : F_SETLK, &lk) == 0;
+	}
+
+	void open(const char *name, int count)
+	{
+		shm_name = std::string("/rio-") + name;
+		processes = count;
+		fd = shm_open(shm_name.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+		if (fd < 0)
+		{
+			fatal_error("Failed to create the --sync shared memory object", -errno);
+		}
+
+		for (;;)
+		{
+			// Only a process alone with the object gets the write lock: it just created it, or its users are gone
+			if (lock(fd, F_WRLCK, false))
+			{
+				// Truncating first zero-fills whatever a dead run left behind
+				if (ftruncate(fd, 0) < 0 || ftruncate(fd, sizeof(SyncArea)) < 0)
+				{
+					fatal_error("Failed to reset the --sync shared memory object", -errno);
+				}
+				map();
+				area->processes.store(processes, std::memory_order_relaxed);
+				area->magic.store(SYNC_MAGIC, std::memory_order_release);
+				lock(fd, F_RDLCK, false); // atomic downgrade: joiners can proceed
+				break;
+			}
+			// Blocks while another process initializes the object, which may also not have been locked yet
+			if (!lock(fd, F_RDLCK, true))
+			{
+				fatal_error("Failed to lock the --sync shared memory object", -errno);
+			}
+			struct stat st;
+			if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(SyncArea))
+			{
+				map();
+				if (area->magic.load(std::memory_order_acquire) == SYNC_MAGIC)
+					break;
+				munmap(area, sizeof(SyncArea));
+			}
+			lock(fd, F_UNLCK, false);
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+
+		if (area->processes.load(std::memory_order_relaxed) != processes)
+		{
+			fatal_error(("--sync: " + shm_name.substr(1) + " is in use with a different process count").c_str());
+		}
+	}
+
+	void map()
+	{
+		void *p = mmap(nullptr, sizeof(SyncArea), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if (p == MAP_FAILED)
+		{
+			fatal_error("Failed to map the --sync shared memory object", -errno);
+		}
+		area = (SyncArea *)p;
+	}
+
+	void wait()
+	{
+		uint32_t gen = area->generation.load(std::memory_order_acquire);
+		if (area->arrived.fetch_add(1, std::memory_order_acq_rel) + 1 == processes)
+		{
+			area->arrived.store(0, std::memory_order_relaxed);
+			area->generation.store(gen + 1, std::memory_order_release);
+			return;
+		}
+		while (area->generation.load(std::memory_order_acquire) == gen)
+		{
+			if (area->finished.load(std::memory_order_relaxed) > 0)
+			{
+				fatal_error("--sync: another process finished; all of them must run the same number of phases");
+			}
+			std::this_thread::sleep_for(std::chrono::microseconds(20));
+		}
+	}
+
+	// Every process has mapped the object by the time the last phase starts, so the name can go
+	void close_object()
+	{
+		area->finished.fetch_add(1, std::memory_order_relaxed);
+		munmap(area, sizeof(SyncArea));
+		shm_unlink(shm_name.c_str());
+		close(fd);
+	}
+};
+
+// Phase sequencing between the main thread and the workers. For each phase the main thread assigns work and meets
+// the workers at `go`. Active workers then set up and meet each other at `start`, so every job starts issuing I/O
+// together, run, and meet the main thread again at `done`.
+struct RunControl
+{
+	StartBarrier go;
+	StartBarrier start;
+	StartBarrier done;
+	TimePoint origin;         // start of the first phase; trace timestamps are relative to it
+	cpu_set_t default_cpus;   // affinity of unpinned workers
+	bool realtime = false;    // --rt: workers run SCHED_FIFO
+	bool finished = false;
+	LogCommitter log_committer;
+};
+
+// What the slot buffers currently hold, so a phase only regenerates content when its settings differ. Every one of
+// the worker's buffer_count buffers is filled, so a later phase with a deeper queue finds them ready too
+struct BufferContent
+{
+	bool shaped = false;
+	int compress_percentage = 0;
+	bool dedupe = false;
+	bool verify = false;
+	uint64_t verify_seed = 0;
+	size_t block_size = 0;
+
+	bool operator==(const BufferContent &) const = default;
+};
+
+// Per-phase results of one worker, merged per job once all workers are done
+struct WorkerResults
+{
+	TimePoint start_time;
+	TimePoint end_time;
+	AppendLog<double> latencies;
+	AppendLog<double> class_latencies[2]; // --prio: I/Os issued at the default priority [0] and with --prio [1]
+	uint64_t completed_ops = 0;
+	double cpu_sec = 0; // worker thread CPU time over the workload, for IOPS per core
+	ErrorStats error_stats;
+	TimeoutStats timeout_stats;
+	SlowIOTracker slow;
+	Heatmap heatmap;
+	QueueOccupancy occupancy;
+	VerifyStats verify_stats;
+#ifdef RIO_ALLOC_GUARD
+	AllocGuard alloc_guard; // allocations made while the queue was running
+#endif
+};
+
+// One worker thread with its own ring, I/O slots and buffers, running a share of its job in every phase. The ring
+// and buffers live as long as the thread: slots and buffers are allocated once for the largest queue depth and
+// block size of any phase, and the ring is rebuilt only when a phase needs a different kind of ring or target.
+struct Worker
+{
+	int id = 0;              // index across all jobs, recorded in traces
+	int slot_capacity = 0;   // I/O slots, the largest iodepth of any phase
+	size_t buffer_size = 0;  // the largest block size of any phase
+	int buffer_count = 0;    // slot buffers; fewer than slots with --buffer_pool, slot i using buffer i % buffer_count
+	bool has_dedupe = false; // some phase draws writes from the dedupe buffers
+	LiveStats *live = nullptr;
+	TraceRing *trace = nullptr;
+	RunControl *ctl = nullptr;
+
+	// Assignment for the current phase; cfg is null when the worker sits the phase out
+	const Config *cfg = nullptr;
+	NVMeDevice *nvme = nullptr;
+	uint64_t total_ops = 0; // this worker's share of --size; UINT64_MAX when time based
+	uint64_t rate_iops = 0; // this worker's share of --rate_iops
+	uint64_t region_base = 0; // LBAs random I/O is drawn from (--offset, --io_range, --offset_increment)
+	uint64_t region_count = 0;
+	uint64_t lba_base = 0; // slice of the region for sequential and verified writes
+	uint64_t lba_count = 0;
+	int cpu = -1; // --numjobs=hwq: CPU to run on, -1 for any
+	int phase = 0;
+	OffsetLog *record = nullptr; // --record_offsets: where this phase's LBAs go
+	OffsetLog *replay = nullptr; // --replay_offsets: the LBAs to issue in this phase
+
+	// Set up on the worker thread itself: rings are created single-issuer
+	struct io_uring ring;
+	int pinned_cpu = -1;
+	bool realtime = false; // thread already switched to SCHED_FIFO
+	bool ring_ready = false;
+	bool ring_passthrough = false;
+	SubmitMode ring_submit_mode = SubmitMode::SUBMIT_AND_WAIT;
+	bool ring_iopoll = false;
+	bool ring_hugepages = false;
+	RingMemory ring_mem;
+	int ring_fd = -1;
+	bool buffers_registered = false;
+	IOContext *io_contexts = nullptr;
+	char *sqe_templates = nullptr; // one per slot, SQE_TEMPLATE_STRIDE apart, rebuilt every phase
+	std::vector<void *> dedupe_buffers;
+	BufferContent content;
+
+	WorkerResults res;
+	std::thread thread;
+};
+
+// A job: one workload description and its target, run by cfg->numjobs of its workers. cfg and nvme follow the
+// current phase.
+struct Job
+{
+	const Config *cfg = nullptr;
+	NVMeDevice *nvme = nullptr;
+	std::vector<Worker *> workers;
+	std::vector<Worker *> active; // workers taking part in the current phase
+};
+
+// Make the worker's ring, buffers and buffer content fit the current phase, reusing whatever already does
+static void prepare_worker(Worker *w)
+{
+	const Config &cfg = *w->cfg;
+	NVMeDevice &nvme = *w->nvme;
+	int ret;
+
+	if (!w->ring_ready || w->ring_passthrough != cfg.passthrough || w->ring_submit_mode != cfg.submit_mode ||
+	    w->ring_iopoll != cfg.iopoll || w->ring_hugepages != cfg.hugepage_rings || w->ring_fd != nvme.fd)
+	{
+		if (w->ring_ready)
+		{
+			io_uring_queue_exit(&w->ring);
+			free_ring_memory(&w->ring_mem);
+		}
+		setup_io_uring(&w->ring, w->slot_capacity, cfg.passthrough, cfg.submit_mode, cfg.iopoll,
+		               cfg.hugepage_rings ? &w->ring_mem : nullptr);
+
+		// Register the file descriptor for fixed file access (avoids per-I/O fd lookup)
+		ret = io_uring_register_files(&w->ring, &nvme.fd, 1);
+		if (ret < 0)
+		{
+			fatal_error("io_uring_register_files failed", ret);
+		}
+		w->ring_ready = true;
+		w->ring_passthrough = cfg.passthrough;
+		w->ring_submit_mode = cfg.submit_mode;
+		w->ring_iopoll = cfg.iopoll;
+		w->ring_hugepages = cfg.hugepage_rings;
+		w->ring_fd = nvme.fd;
+		w->buffers_registered = false;
+	}
+
+	// Allocate IO contexts (buffer + timing info). 4 KiB alignment suits any LBA size a phase may target.
+	if (!w->io_contexts)
+	{
+		w->io_contexts = new IOContext[w->slot_capacity];
+		w->sqe_templates = (char *)alloc_aligned_buffer(w->slot_capacity * SQE_TEMPLATE_STRIDE, 64);
+		for (int i = 0; i < w->slot_capacity; i++)
+		{
+			w->io_contexts[i].buffer = i < w->buffer_count ? alloc_aligned_buffer(w->buffer_size, 4096)
+			                                               : w->io_contexts[i % w->buffer_count].buffer;
+		}
+		for (int i = 0; w->has_dedupe && i < DEDUPE_BUFFERS; i++)
+		{
+			w->dedupe_buffers.push_back(alloc_aligned_buffer(w->buffer_size, 4096));
+		}
+	}
+	for (int i = 0; i < w->slot_capacity; i++)
+	{
+		IOContext *ctx = &w->io_contexts[i];
+		*ctx = IOContext {.buffer = ctx->buffer};
+	}
+
+	// Shaped write content: slot buffers get the requested compressibility, and dedupe writes draw from a few shared
+	// buffers registered after the slot buffers
+	BufferContent content;
+	content.shaped = is_write_type(cfg.type) && (cfg.buffer_compress_percentage >= 0 || cfg.dedupe_percentage > 0);
+	content.compress_percentage = std::max(cfg.buffer_compress_percentage, 0);
+	content.dedupe = content.shaped && cfg.dedupe_percentage > 0;
+	content.verify = cfg.verify;
+	content.verify_seed = cfg.verify_seed;
+	content.block_size = cfg.block_size;
+	if (content.shaped && content != w->content)
+	{
+		for (int i = 0; i < w->buffer_count; i++)
+		{
+			build_buffer_content(w->io_contexts[i].buffer, cfg.block_size, content.compress_percentage);
+		}
+		for (int i = 0; content.dedupe && i < DEDUPE_BUFFERS; i++)
+		{
+			build_buffer_content(w->dedupe_buffers[i], cfg.block_size, content.compress_percentage);
+		}
+	}
+	// Verify mode: give every buffer a seed-derived payload once; per-I/O work is only header stamping and CRC
+	else if (content.verify && content != w->content)
+	{
+		for (int i = 0; i < w->buffer_count; i++)
+		{
+			fill_verify_pattern(w->io_contexts[i].buffer, cfg.block_size, cfg.verify_seed ^ i);
+		}
+	}
+	w->content = content;
+
+	// Register buffers for fixed buffer I/O (avoids per-I/O page table walks)
+	if (!cfg.passthrough && !w->buffers_registered)
+	{
+		int nr_buffers = w->buffer_count + (int)w->dedupe_buffers.size();
+		struct iovec *iovecs = new struct iovec[nr_buffers];
+		for (int i = 0; i < nr_buffers; i++)
+		{
+			iovecs[i].iov_base =
+			    i < w->buffer_count ? w->io_contexts[i].buffer : w->dedupe_buffers[i - w->buffer_count];
+			iovecs[i].iov_len = w->buffer_size;
+		}
+		ret = io_uring_register_buffers(&w->ring, iovecs, nr_buffers);
+		if (ret < 0)
+		{
+			fatal_error("io_uring_register_buffers failed", ret);
+		}
+		delete[] iovecs;
+		w->buffers_registered = true;
+	}
+
+	for (int i = 0; i < cfg.iodepth; i++)
+	{
+		build_sqe_template((struct io_uring_sqe *)(w->sqe_templates + i * SQE_TEMPLATE_STRIDE), nvme, 0,
+		                   cfg.passthrough, is_write_type(cfg.type), w->io_contexts[i].buffer, i % w->buffer_count, i);
+	}
+}
+
+static void release_worker(Worker *w)
+{
+	if (w->io_contexts)
+	{
+		for (int i = 0; i < w->buffer_count; i++)
+		{
+			free(w->io_contexts[i].buffer);
+		}
+		delete[] w->io_contexts;
+		free(w->sqe_templates);
+	}
+	for (void *buf : w->dedupe_buffers)
+	{
+		free(buf);
+	}
+	if (w->ring_ready)
+	{
+		io_uring_queue_exit(&w->ring);
+		free_ring_memory(&w->ring_mem);
+	}
+}
+
+static double thread_cpu_seconds()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void run_workload(Worker *w)
+{
+	double cpu_start = thread_cpu_seconds();
+	const Config &cfg = *w->cfg;
+	NVMeDevice &nvme = *w->nvme;
+	struct io_uring &ring = w->ring;
+	IOContext *io_contexts = w->io_contexts;
+	const int fixed_fd_idx = 0; // Index into registered files array
+	auto slot_sqe = [&](int slot) { return (struct io_uring_sqe *)(w->sqe_templates + slot * SQE_TEMPLATE_STRIDE); };
+	const std::vector<void *> &dedupe_buffers = w->dedupe_buffers;
+	bool is_write = is_write_type(cfg.type);
+	bool sequential = is_sequential_type(cfg.type);
+
+	// Calculate workload parameters
+	uint64_t block_lbas = cfg.block_size / nvme.lba_size;
+	bool time_based = cfg.runtime > 0 && !w->replay; // a replay issues what was recorded
+	uint64_t total_ops = w->total_ops;
+	TimePoint start_time = w->res.start_time;
+	TimePoint deadline = time_based ? start_time + std::chrono::seconds(cfg.runtime) : TimePoint {};
+
+	// Latency tracking. Logs are sized for the most I/Os the phase can complete, so recording never allocates
+	size_t max_ios = time_based ? (size_t)cfg.runtime * APPEND_LOG_MAX_RATE : total_ops;
+	AppendLog<double> &latencies = w->res.latencies;
+	latencies.reserve(max_ios);
+	if (cfg.ioprio)
+	{
+		w->res.class_latencies[0].reserve(max_ios);
+		w->res.class_latencies[1].reserve(max_ios);
+	}
+	if (w->record)
+	{
+		w->record->data.reserve(max_ios * 10); // at most ten varint bytes per LBA
+	}
+	LiveStats *live = w->live;
+
+	// Track progress
+	uint64_t submitted_ops = 0;
+	uint64_t completed_ops = 0;
+	int in_flight = 0;
+
+	// Verify mode bookkeeping: inline checks for reads, a log of written blocks for the post-write pass
+	VerifyStats &verify_stats = w->res.verify_stats;
+	AppendLog<WrittenBlock> written;
+	uint64_t write_generation = 0;
+	if (cfg.seed)
+	{
+		// One stream per worker and phase: the same options and seed give the same I/Os on every run
+		std::seed_seq seq {(uint32_t)cfg.seed, (uint32_t)(cfg.seed >> 32), (uint32_t)w->id, (uint32_t)w->phase};
+		thread_rng().seed(seq);
+	}
+	uint64_t content_sequence = thread_rng()(); // random base keeps unique content unique across runs
+	int dedupe_next = 0;
+	uint64_t next_seq_lba = w->lba_base;
+	InFlightLBAs verify_lbas;
+	if (cfg.verify && is_write)
+	{
+		written.reserve(max_ios);
+		verify_lbas.init(cfg.iodepth);
+	}
+
+	// Pick an LBA for a slot, stamp it in verify mode and queue it
+	auto issue_io = [&](int buf_idx)
+	{
+		IOContext *ctx = &io_contexts[buf_idx];
+		if (w->replay)
+		{
+			if (!w->replay->next(&ctx->lba) || ctx->lba + block_lbas > nvme.nlba)
+			{
+				fatal_error("--replay_offsets: recorded LBAs do not fit this device and block size");
+			}
+		}
+		else if (cfg.verify && is_write)
+		{
+			ctx->lba = verify_write_lba(&verify_lbas, buf_idx, ctx->lba, w->lba_base, w->lba_count, block_lbas);
+			ctx->generation = ++write_generation;
+			stamp_verify_headers(ctx->buffer, ctx->lba, block_lbas, nvme.lba_size, ctx->generation, cfg.verify_seed);
+		}
+		else if (sequential)
+		{
+			if (next_seq_lba + block_lbas > w->lba_base + w->lba_count)
+			{
+				next_seq_lba = w->lba_base;
+			}
+			ctx->lba = next_seq_lba;
+			next_seq_lba += block_lbas;
+		}
+		else
+		{
+			ctx->lba = w->region_base + random_lba(w->region_count, block_lbas);
+		}
+
+		if (w->record)
+		{
+			w->record->append(ctx->lba);
+		}
+
+		void *buf = ctx->buffer;
+		int reg_idx = -1; // the template's
+		ctx->dedupe_buf = -1;
+		if (!dedupe_buffers.empty() && random_chance(cfg.dedupe_percentage))
+		{
+			ctx->dedupe_buf = (int8_t)dedupe_next;
+			reg_idx = w->buffer_count + dedupe_next;
+			buf = dedupe_buffers[dedupe_next];
+			dedupe_next = (dedupe_next + 1) % DEDUPE_BUFFERS;
+		}
+		else if (w->content.shaped && !cfg.verify)
+		{
+			stamp_unique_content(buf, cfg.block_size, ++content_sequence);
+		}
+
+		ctx->ioprio = cfg.prio_percentage == 100 || random_chance(cfg.prio_percentage) ? cfg.ioprio : 0;
+		ctx->queue_depth = in_flight + 1;
+		ctx->submit_time = Clock::now();
+		submit_slot(&ring, slot_sqe(buf_idx), cfg.passthrough, buf, reg_idx, ctx->lba, block_lbas, nvme.lba_size,
+		            ctx->ioprio);
+
+		in_flight++;
+	};
+
+	// --rate_iops: I/Os go out no earlier than their place in a fixed schedule. A slot that frees up ahead of
+	// schedule is parked and issued from the loop, whose waits are then bounded by the next issue time. Falling
+	// behind, for example after a stall, earns at most a queue depth's worth of catch-up.
+	const auto issue_interval = std::chrono::nanoseconds(w->rate_iops ? 1000000000ULL / w->rate_iops : 0);
+	TimePoint next_issue = start_time;
+	std::vector<int> parked;
+	parked.reserve(cfg.iodepth); // each slot is parked at most once
+
+	auto issue_paced = [&](int buf_idx, TimePoint now)
+	{
+		next_issue = std::max(next_issue, now - issue_interval * cfg.iodepth) + issue_interval;
+		issue_io(buf_idx);
+	};
+
+	auto start_io = [&](int buf_idx, TimePoint now)
+	{
+		submitted_ops++;
+		if (w->rate_iops == 0)
+		{
+			issue_io(buf_idx);
+		}
+		else if (now >= next_issue && parked.empty())
+		{
+			issue_paced(buf_idx, now);
+		}
+		else
+		{
+			io_contexts[buf_idx].submit_time = TimePoint::max();
+			parked.push_back(buf_idx);
+		}
+	};
+
+	// Resubmit a failed I/O to the same LBA from the buffer it was issued from, so a dedupe write keeps its content
+	auto retry_io = [&](int buf_idx)
+	{
+		IOContext *ctx = &io_contexts[buf_idx];
+		void *buf = ctx->dedupe_buf < 0 ? ctx->buffer : dedupe_buffers[ctx->dedupe_buf];
+		int reg_idx = ctx->dedupe_buf < 0 ? -1 : w->buffer_count + ctx->dedupe_buf;
+		ctx->retries++;
+		ctx->submit_time = Clock::now();
+		submit_slot(&ring, slot_sqe(buf_idx), cfg.passthrough, buf, reg_idx, ctx->lba, block_lbas, nvme.lba_size,
+		            ctx->ioprio);
+	};
+
+	SlowIOTracker &slow = w->res.slow;
+	slow.top_n = cfg.slowest;
+	slow.threshold_ns = (uint64_t)cfg.slow_threshold_us * 1000;
+	slow.heap.reserve(slow.top_n);
+	if (slow.threshold_ns > 0)
+	{
+		slow.log.reserve(max_ios);
+	}
+
+	Heatmap &heatmap = w->res.heatmap;
+	if (cfg.heatmap)
+	{
+		size_t intervals =
+		    time_based ? (size_t)cfg.runtime * 1000 / cfg.heatmap_interval_ms + 2 : HEATMAP_MAX_INTERVALS;
+		heatmap.init(nvme.nlba, cfg.heatmap_regions, std::chrono::milliseconds(cfg.heatmap_interval_ms), start_time,
+		             intervals);
+	}
+
+	TraceRing *trace = w->trace;
+	TimePoint trace_origin = w->ctl->origin;
+
+	ErrorStats &error_stats = w->res.error_stats;
+	TimeoutStats &timeout_stats = w->res.timeout_stats;
+	const auto io_timeout = std::chrono::milliseconds(cfg.io_timeout_ms);
+	// Sweep at a quarter of the timeout so overdue commands are noticed within 1.25x the limit
+	const auto sweep_interval = std::max(io_timeout / 4, std::chrono::milliseconds(1));
+	struct __kernel_timespec wait_ts = {
+	    .tv_sec = sweep_interval.count() / 1000,
+	    .tv_nsec = (sweep_interval.count() % 1000) * 1000000,
+	};
+	TimePoint next_sweep = Clock::now() + sweep_interval;
+	bool continue_on_error = cfg.continue_on_error & (is_write ? CONTINUE_ON_WRITE : CONTINUE_ON_READ);
+
+	// Have the committer keep this phase's logs writable ahead of the loop
+	std::vector<AppendLogSpace *> logs = {&latencies.space, &w->res.class_latencies[0].space,
+	                                      &w->res.class_latencies[1].space, &written.space, &slow.log.space};
+	if (w->record)
+	{
+		logs.push_back(&w->record->data.space);
+	}
+	for (AppendLogSpace *log : logs)
+	{
+		w->ctl->log_committer.watch(log);
+	}
+
+	// Fill queue with initial operations
+	for (int i = 0; i < cfg.iodepth && submitted_ops < total_ops; i++)
+	{
+		start_io(i, start_time);
+	}
+
+	// Submit initial batch (in SQPOLL mode, flushes SQ tail for kernel thread)
+	{
+		int ret = io_uring_submit(&ring);
+		if (ret < 0)
+		{
+			fatal_error("io_uring_submit failed", ret);
+		}
+	}
+
+	// Queue occupancy. Waits end on the first completion, so the device is taken to hold every submitted I/O while
+	// the loop sleeps, less any further completions that queued up before it woke. While completions are processed
+	// (and until reissued I/Os are submitted) the reaped ones and any new arrivals are no longer at the device.
+	// Only with --queue_stats: it costs two clock reads per loop iteration.
+	const bool queue_stats = cfg.queue_stats;
+	QueueOccupancy &occupancy = w->res.occupancy;
+	occupancy.init(cfg.iodepth, Clock::now());
+	int wake_outstanding = 0;
+	int wake_device = 0;
+	unsigned reaped = 0;
+
+#ifdef RIO_ALLOC_GUARD
+	// The queue is full: from here until it drains, nothing may allocate
+	alloc_guard = AllocGuard {};
+	alloc_guard.armed = true;
+#endif
+
+	// Main workload loop
+	// For time-based: run until deadline, then drain in-flight ops
+	while (in_flight > 0 || !parked.empty() || (!time_based && completed_ops < total_ops))
+	{
+		struct io_uring_cqe *cqe;
+		int ret = 0;
+
+		if (queue_stats)
+		{
+			int device_now = std::max(wake_outstanding - (int)reaped - (int)io_uring_cq_ready(&ring), 0);
+			occupancy.account(Clock::now(), wake_outstanding, wake_device, device_now);
+		}
+
+		// With --io_timeout the waits are bounded so overdue commands are swept even when nothing completes
+		bool bounded_wait = cfg.io_timeout_ms > 0;
+		struct __kernel_timespec ts = wait_ts;
+		if (!parked.empty())
+		{
+			TimePoint now = Clock::now();
+			if (time_based && now >= deadline)
+			{
+				parked.clear();
+			}
+			while (!parked.empty() && now >= next_issue)
+			{
+				issue_paced(parked.back(), now);
+				parked.pop_back();
+			}
+			if (!parked.empty())
+			{
+				auto until = std::chrono::duration_cast<std::chrono::nanoseconds>(next_issue - now);
+				if (!bounded_wait || until < sweep_interval)
+				{
+					ts = {.tv_sec = until.count() / 1000000000, .tv_nsec = until.count() % 1000000000};
+				}
+				bounded_wait = true;
+			}
+			else if (in_flight == 0)
+			{
+				continue;
+			}
+		}
+
+		switch (cfg.submit_mode)
+		{
+		case SubmitMode::SUBMIT_AND_WAIT:
+			// Single syscall: submit pending SQEs and wait for completion
+			if (bounded_wait)
+				ret = io_uring_submit_and_wait_timeout(&ring, &cqe, 1, &ts, nullptr);
+			else
+				ret = io_uring_submit_and_wait(&ring, 1);
+			break;
+
+		case SubmitMode::SUBMIT:
+			// Two syscalls: submit first, then wait separately
+			ret = io_uring_submit(&ring);
+			if (ret < 0)
+			{
+				fatal_error("io_uring_submit failed", ret);
+			}
+			ret = bounded_wait ? io_uring_wait_cqe_timeout(&ring, &cqe, &ts) : io_uring_wait_cqe(&ring, &cqe);
+			break;
+
+		case SubmitMode::SQPOLL:
+			// Flush SQ tail and wake kernel thread if idle; no actual submit syscall
+			io_uring_submit(&ring);
+			ret = bounded_wait ? io_uring_wait_cqe_timeout(&ring, &cqe, &ts) : io_uring_wait_cqe(&ring, &cqe);
+			break;
+		}
+
+		if (ret < 0 && !(bounded_wait && ret == -ETIME))
+		{
+			fatal_error("io_uring wait failed", ret);
+		}
+
+		if (queue_stats)
+		{
+			int ready = (int)io_uring_cq_ready(&ring);
+			wake_outstanding = in_flight;
+			wake_device = std::max(in_flight - ready, 0);
+			occupancy.account(Clock::now(), in_flight, in_flight, std::min(in_flight - ready + 1, in_flight));
+		}
+
+		// Process completions
+		unsigned head;
+		unsigned count = 0;
+
+		io_uring_for_each_cqe(&ring, head, cqe)
+		{
+			count++;
+			if (cqe->user_data == CANCEL_USER_DATA)
+			{
+				if (cqe->res < 0)
+					timeout_stats.cancel_failed++;
+				continue;
+			}
+
+			int buf_idx = (int)(uintptr_t)io_uring_cqe_get_data(cqe);
+
+			// Calculate latency for this operation
+			TimePoint complete_time = Clock::now();
+
+			int status = io_status(cqe, cfg.passthrough);
+			// A command our own timeout sweep cancelled is already accounted in timeout_stats: it is neither fatal
+			// nor retried, and has no latency to record
+			bool cancelled = false;
+			if (io_contexts[buf_idx].timed_out)
+			{
+				io_contexts[buf_idx].timed_out = false;
+				cancelled = status == -ECANCELED;
+				if (cancelled)
+					timeout_stats.cancelled++;
+				else
+					timeout_stats.late++;
+			}
+			if (status != 0 && !cancelled)
+			{
+				if (!continue_on_error)
+				{
+					fatal_error(("I/O operation failed: " + describe_io_status(status)).c_str());
+				}
+				IOContext *ctx = &io_contexts[buf_idx];
+				double elapsed = std::chrono::duration<double>(complete_time - start_time).count();
+				record_io_error(&error_stats, cqe, status, cfg.passthrough, is_write, ctx->lba, elapsed);
+				if (live)
+				{
+					bump(live->errors, 1);
+				}
+
+				if (ctx->retries < cfg.error_retries)
+				{
+					error_stats.retried++;
+					retry_io(buf_idx);
+					continue;
+				}
+				error_stats.failed++;
+			}
+			else if (status == 0)
+			{
+				auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(complete_time -
+				                                                                     io_contexts[buf_idx].submit_time);
+				double latency_us = duration.count() / 1000.0;
+				latencies.push_back(latency_us);
+				if (cfg.ioprio)
+				{
+					w->res.class_latencies[io_contexts[buf_idx].ioprio != 0].push_back(latency_us);
+				}
+				if (live)
+				{
+					live->record(duration.count(), cfg.block_size);
+				}
+				if (cfg.heatmap)
+				{
+					heatmap.record(io_contexts[buf_idx].lba, duration.count(), complete_time);
+				}
+				if (slow.enabled() && slow.wants(duration.count()))
+				{
+					const IOContext *ctx = &io_contexts[buf_idx];
+					uint64_t submit_ns =
+					    std::chrono::duration_cast<std::chrono::nanoseconds>(ctx->submit_time - start_time).count();
+					slow.record({(uint64_t)duration.count(), submit_ns, ctx->lba, (uint32_t)cfg.block_size,
+					             ctx->queue_depth, is_write});
+				}
+			}
+			io_contexts[buf_idx].retries = 0;
+
+			if (trace)
+			{
+				const IOContext *ctx = &io_contexts[buf_idx];
+				TraceEvent ev;
+				ev.submit_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(ctx->submit_time - trace_origin)
+				                   .count();
+				ev.complete_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(complete_time - trace_origin)
+				                     .count();
+				ev.lba = ctx->lba;
+				ev.blocks = block_lbas - 1;
+				ev.op = is_write ? TRACE_WRITE : TRACE_READ;
+				ev.failed = status != 0;
+				ev.worker = w->id;
+				trace->append(ev);
+			}
+
+			if (cfg.verify && status == 0)
+			{
+				const IOContext *ctx = &io_contexts[buf_idx];
+				if (is_write)
+					written.push_back({ctx->lba, ctx->generation});
+				else
+					check_verify_headers(ctx->buffer, ctx->lba, block_lbas, nvme.lba_size, cfg.verify_seed, 0,
+					                     &verify_stats);
+			}
+
+			completed_ops++;
+			in_flight--;
+
+			// Resubmit if more work to do (check deadline for time-based mode)
+			bool should_submit = time_based ? (complete_time < deadline) : (submitted_ops < total_ops);
+			if (should_submit)
+			{
+				start_io(buf_idx, complete_time);
+			}
+			else
+			{
+				io_contexts[buf_idx].submit_time = TimePoint::max();
+			}
+		}
+
+		io_uring_cq_advance(&ring, count);
+		reaped = count;
+
+		if (cfg.io_timeout_ms > 0)
+		{
+			TimePoint now = Clock::now();
+			if (now >= next_sweep)
+			{
+				sweep_timeouts(&ring, io_contexts, cfg.iodepth, is_write, now, start_time, io_timeout,
+				               &timeout_stats);
+				next_sweep = now + sweep_interval;
+			}
+		}
+	}
+
+	w->res.end_time = Clock::now();
+	w->res.cpu_sec = thread_cpu_seconds() - cpu_start;
+#ifdef RIO_ALLOC_GUARD
+	alloc_guard.armed = false;
+	w->res.alloc_guard = alloc_guard;
+#endif
+	for (AppendLogSpace *log : logs)
+	{
+		w->ctl->log_committer.unwatch(log);
+	}
+	if (queue_stats)
+	{
+		occupancy.account(w->res.end_time, wake_outstanding, wake_device,
+		                  std::max(wake_outstanding - (int)reaped, 0));
+	}
+	w->res.completed_ops = completed_ops;
+
+	// Read back what was written while the ring and buffers are still set up
+	if (cfg.verify && is_write)
+	{
+		run_verify_pass(&ring, &nvme, cfg, fixed_fd_idx, io_contexts, written, &verify_stats);
+	}
+}
+
+// Worker thread: sit out or run each phase as assigned by the main thread, keeping the ring and buffers between
+// phases
+static void worker_main(Worker *w)
+{
+	RunControl *ctl = w->ctl;
+	for (;;)
+	{
+		ctl->go.wait();
+		if (ctl->finished)
+		{
+			break;
+		}
+		if (w->cfg)
+		{
+			// Pin before setting up, so the ring and buffers are allocated on the queue's node
+			if (w->cpu != w->pinned_cpu)
+			{
+				cpu_set_t cpus = ctl->default_cpus;
+				if (w->cpu >= 0)
+				{
+					CPU_ZERO(&cpus);
+					CPU_SET(w->cpu, &cpus);
+				}
+				int ret = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+				if (ret != 0)
+				{
+					fatal_error("pthread_setaffinity_np failed", -ret);
+				}
+				w->pinned_cpu = w->cpu;
+			}
+			if (ctl->realtime && !w->realtime)
+			{
+				sched_param param = {};
+				param.sched_priority = RT_PRIORITY;
+				int ret = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+				if (ret != 0)
+				{
+					fatal_error("--rt: SCHED_FIFO not permitted; run as root or grant CAP_SYS_NICE", -ret);
+				}
+				w->realtime = true;
+			}
+			prepare_worker(w);
+			w->res = WorkerResults {};
+			w->res.start_time = ctl->start.wait();
+			run_workload(w);
+		}
+		ctl->done.wait();
+	}
+	release_worker(w);
+}
+
+// Merge the workers of a job and print its report for the phase just run. Returns the job's exit status.
+static int report_job(Job &job, TimePoint start_time, bool named, const char *phase, Metrics *metrics)
+{
+	const Config &cfg = *job.cfg;
+	bool is_write = is_write_type(cfg.type);
+
+	std::vector<double> latencies;
+	std::vector<double> class_latencies[2];
+	uint64_t completed_ops = 0;
+	uint64_t unrecorded = 0;
+	double cpu_sec = 0;
+	TimePoint end_time = start_time;
+	ErrorStats error_stats;
+	TimeoutStats timeout_stats;
+	SlowIOTracker slow;
+	slow.top_n = cfg.slowest;
+	slow.threshold_ns = (uint64_t)cfg.slow_threshold_us * 1000;
+	Heatmap heatmap = job.active[0]->res.heatmap;
+	QueueOccupancy occupancy;
+	VerifyStats verify_stats;
+	size_t slow_logged = 0;
+	for (const Worker *w : job.active)
+	{
+		slow_logged += w->res.slow.log.size();
+	}
+	slow.log.reserve(slow_logged);
+	for (size_t i = 0; i < job.active.size(); i++)
+	{
+		const WorkerResults &res = job.active[i]->res;
+		latencies.insert(latencies.end(), res.latencies.begin(), res.latencies.end());
+		for (int c = 0; c < 2; c++)
+		{
+			class_latencies[c].insert(class_latencies[c].end(), res.class_latencies[c].begin(),
+			                          res.class_latencies[c].end());
+		}
+		completed_ops += res.completed_ops;
+		unrecorded += res.latencies.dropped;
+		cpu_sec += res.cpu_sec;
+		end_time = std::max(end_time, res.end_time);
+		error_stats.merge(res.error_stats);
+		timeout_stats.merge(res.timeout_stats);
+		slow.merge(res.slow);
+		if (i > 0)
+		{
+			heatmap.merge(res.heatmap);
+		}
+		occupancy.merge(res.occupancy);
+		verify_stats.merge(res.verify_stats);
+	}
+	double elapsed_sec = std::chrono::duration<double>(end_time - start_time).count();
+
+	if (named)
+	{
+		std::cout << "\nJob " << cfg.name << ": " << cfg.type << ", bs " << cfg.block_size << ", iodepth "
+		          << cfg.iodepth << ", " << cfg.numjobs << " worker(s), ";
+		if (cfg.ioprio)
+		{
+			std::cout << "prio " << describe_ioprio(cfg.ioprio) << ", ";
+		}
+		std::cout << cfg.filename << "\n";
+	}
+
+	// Print metrics (failed I/Os and those cancelled by --io_timeout count towards completion but not towards IOPS or
+	// latency; the timeout summary lists the cancelled ones)
+	uint64_t done_ops = completed_ops - error_stats.failed - timeout_stats.cancelled;
+	*metrics = compute_metrics(latencies, elapsed_sec, done_ops, cfg.block_size);
+	print_metrics(*metrics);
+	if (unrecorded > 0)
+	{
+		std::cout << "  Note: latency of " << unrecorded << " I/Os not recorded, the per-worker log was full\n";
+	}
+	if (cpu_sec > 0)
+	{
+		std::cout << "  IOPS/core:  " << std::fixed << std::setprecision(0) << metrics->iops * elapsed_sec / cpu_sec
+		          << " (workers busy " << std::setprecision(2) << cpu_sec / elapsed_sec << " cores)\n";
+	}
+	if (cfg.queue_stats)
+	{
+		double avg_latency_us =
+		    latencies.empty() ? 0.0 : std::accumulate(latencies.begin(), latencies.end(), 0.0) / latencies.size();
+		print_queue_occupancy(occupancy, cfg.iodepth, (int)job.active.size(), cfg.rate_iops > 0,
+		                      done_ops / elapsed_sec, avg_latency_us);
+		for (size_t i = 0; job.active.size() > 1 && i < job.active.size(); i++)
+		{
+			const QueueOccupancy &occ = job.active[i]->res.occupancy;
+			std::cout << "  worker " << i << ":    outstanding " << std::fixed << std::setprecision(2)
+			          << occ.avg_outstanding() << ", at device " << occ.avg_device() << "\n";
+		}
+	}
+	if (cfg.ioprio)
+	{
+		print_class_latencies(cfg.ioprio, class_latencies);
+	}
+	if (cfg.continue_on_error || error_stats.errors > 0)
+	{
+		print_error_stats(error_stats);
+	}
+	if (cfg.io_timeout_ms > 0)
+	{
+		print_timeout_stats(timeout_stats);
+	}
+	if (slow.enabled())
+	{
+		print_slow_io_report(&slow);
+	}
+	if (cfg.heatmap)
+	{
+		std::string prefix = cfg.heatmap;
+		if (named)
+			prefix += std::string("_") + cfg.name;
+		if (phase)
+			prefix += std::string("_") + phase;
+		write_heatmaps(prefix.c_str(), heatmap);
+	}
+
+#ifdef RIO_ALLOC_GUARD
+	AllocGuard allocs;
+	for (const Worker *w : job.active)
+	{
+		allocs.allocations += w->res.alloc_guard.allocations;
+		allocs.bytes += w->res.alloc_guard.bytes;
+	}
+	std::cout << "Allocation guard: " << allocs.allocations << " allocation(s), " << allocs.bytes
+	          << " bytes on the I/O path\n";
+	if (allocs.allocations > 0)
+	{
+		return 1;
+	}
+#endif
+
+	if (!cfg.verify)
+	{
+		return 0;
+	}
+	print_verify_stats(is_write ? "Verify (read-back pass)" : "Verify (inline)", verify_stats);
+	// Inline checks cannot know which LBAs were written, so unwritten sectors only fail the read-back pass
+	return verify_failures(verify_stats, is_write) > 0 ? 1 : 0;
+}
+
+// Distributed runs: `rio --server` agents run the jobs of a `rio --client` coordinator, which forwards its own
+// command line. Each session runs in a forked child of the agent, so a bad job spec or a failed run ends only that
+// session. For every phase the agents report READY once set up, the coordinator answers with a common wall-clock
+// start time, and the agents return their results with a mergeable latency histogram. Text lines over TCP:
+//
+//   coordinator -> agent   TOKEN <secret>     the shared RIO_AGENT_TOKEN; the agent drops the session otherwise
+//   coordinator -> agent   ARG <option>       one per option, then an empty line
+//   agent -> coordinator   READY <phase> <phase name or ->
+//   coordinator -> agent   START <unix time ns>
+//   agent -> coordinator   RESULT <ops> <bytes> <errors> <elapsed ns> <latency sum ns> <min ns> <max ns> <job or ->
+//                          HIST <bucket>:<count> ...
+//                          (per job that ran, then) END
+//   agent -> coordinator   DONE <exit status>
+//
+// Start times are wall-clock, so agents on different hosts need synchronized clocks (NTP or PTP).
+constexpr int CLUSTER_HIST_SUB_BITS = 7; // 128 sub-buckets: merged percentiles within 1%
+constexpr int CLUSTER_HIST_BUCKETS = (64 - CLUSTER_HIST_SUB_BITS + 1) << CLUSTER_HIST_SUB_BITS;
+
+struct LineReader
+{
+	int fd;
+	std::string buf;
+
+	// False on EOF or error
+	bool read_line(std::string *line)
+	{
+		size_t nl;
+		while ((nl = buf.find('\n')) == std::string::npos)
+		{
+			char chunk[65536];
+			ssize_t n = read(fd, chunk, sizeof(chunk));
+			if (n < 0 && errno == EINTR)
+				continue;
+			if (n <= 0)
+				return false;
+			buf.append(chunk, n);
+		}
+		*line = buf.substr(0, nl);
+		buf.erase(0, nl + 1);
+		return true;
+	}
+};
+
+static bool send_line(int fd, const std::string &line)
+{
+	std::string out = line + "\n";
+	return write_all(fd, out.data(), out.size());
+}
+
+static uint64_t unix_time_ns()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+	           std::chrono::system_clock::now().time_since_epoch())
+	    .count();
+}
+
+// One job's results from one agent (or merged across agents)
+struct ClusterResult
+{
+	uint64_t ops = 0;
+	uint64_t bytes = 0;
+	uint64_t errors = 0;
+	uint64_t elapsed_ns = 0;
+	uint64_t latency_sum_ns = 0;
+	uint64_t min_ns = UINT64_MAX;
+	uint64_t max_ns = 0;
+	std::vector<uint64_t> hist = std::vector<uint64_t>(CLUSTER_HIST_BUCKETS);
+
+	// Agents share one start time, so the merged window is the longest of them
+	void merge(const ClusterResult &other)
+	{
+		ops += other.ops;
+		bytes += other.bytes;
+		errors += other.errors;
+		elapsed_ns = std::max(elapsed_ns, other.elapsed_ns);
+		latency_sum_ns += other.latency_sum_ns;
+		min_ns = std::min(min_ns, other.min_ns);
+		max_ns = std::max(max_ns, other.max_ns);
+		for (int i = 0; i < CLUSTER_HIST_BUCKETS; i++)
+		{
+			hist[i] += other.hist[i];
+		}
+	}
+
+	// Interpolates within the bucket holding the rank, like percentile() does between samples
+	double percentile_us(double p) const
+	{
+		if (ops == 0)
+			return 0.0;
+		double rank = (p / 100.0) * (ops - 1);
+		uint64_t below = 0;
+		for (int i = 0; i < CLUSTER_HIST_BUCKETS; i++)
+		{
+			if (hist[i] > 0 && below + hist[i] > rank)
+			{
+				double lower = i == 0 ? 0 : hist_bucket_upper<CLUSTER_HIST_SUB_BITS>(i - 1);
+				double upper = std::min<double>(hist_bucket_upper<CLUSTER_HIST_SUB_BITS>(i), max_ns + 1.0);
+				double ns = lower + (upper - lower) * (rank - below + 0.5) / hist[i];
+				return std::clamp<double>(ns, min_ns, max_ns) / 1000.0;
+			}
+			below += hist[i];
+		}
+		return max_ns / 1000.0;
+	}
+
+	Metrics metrics() const
+	{
+		double elapsed_sec = elapsed_ns / 1e9;
+		Metrics m;
+		// An agent that completed no I/O may report no elapsed time either
+		m.iops = elapsed_sec > 0 ? ops / elapsed_sec : 0;
+		m.bandwidth_mbs = elapsed_sec > 0 ? bytes / (elapsed_sec * 1024 * 1024) : 0;
+		m.avg_lat = ops ? latency_sum_ns / 1000.0 / ops : 0.0;
+		m.min_lat = ops ? min_ns / 1000.0 : 0.0;
+		m.p50 = percentile_us(50.0);
+		m.p95 = percentile_us(95.0);
+		m.p99 = percentile_us(99.0);
+		m.max_lat = max_ns / 1000.0;
+		return m;
+	}
+};
+
+// Agent side of a session
+struct AgentSession
+{
+	int fd;
+	LineReader in;
+	int phase = 0;
+
+	// Start hook of every phase: runs once all local workers are set up
+	void wait_start(const char *phase_name)
+	{
+		std::string line;
+		uint64_t start_ns;
+		if (!send_line(fd, "READY " + std::to_string(phase) + " " + (phase_name ? phase_name : "-")) ||
+		    !in.read_line(&line) || sscanf(line.c_str(), "START %" SCNu64, &start_ns) != 1)
+		{
+			fatal_error("Lost the coordinator");
+		}
+		// Sleep most of the way, then spin to the exact start
+		uint64_t now = unix_time_ns();
+		if (start_ns > now + 200000)
+		{
+			std::this_thread::sleep_for(std::chrono::nanoseconds(start_ns - now - 200000));
+		}
+		while (unix_time_ns() < start_ns)
+		{
+		}
+	}
+
+	void send_results(const std::vector<Job> &jobs, TimePoint start_time)
+	{
+		for (const Job &job : jobs)
+		{
+			if (job.active.empty())
+				continue;
+			ClusterResult r;
+			TimePoint end_time = start_time;
+			for (const Worker *w : job.active)
+			{
+				for (double latency_us : w->res.latencies)
+				{
+					uint64_t ns = (uint64_t)(latency_us * 1000.0);
+					r.hist[hist_bucket<CLUSTER_HIST_SUB_BITS>(ns)]++;
+					r.latency_sum_ns += ns;
+					r.min_ns = std::min(r.min_ns, ns);
+					r.max_ns = std::max(r.max_ns, ns);
+				}
+				r.ops += w->res.latencies.size();
+				r.errors += w->res.error_stats.failed;
+				end_time = std::max(end_time, w->res.end_time);
+			}
+			r.bytes = r.ops * job.cfg->block_size;
+			r.elapsed_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end_time - start_time).count();
+
+			std::ostringstream out;
+			out << "RESULT " << r.ops << " " << r.bytes << " " << r.errors << " " << r.elapsed_ns << " "
+			    << r.latency_sum_ns << " " << r.min_ns << " " << r.max_ns << " "
+			    << (job.cfg->name ? job.cfg->name : "-") << "\nHIST";
+			for (int i = 0; i < CLUSTER_HIST_BUCKETS; i++)
+			{
+				if (r.hist[i] > 0)
+					out << " " << i << ":" << r.hist[i];
+			}
+			send_line(fd, out.str());
+		}
+		send_line(fd, "END");
+		phase++;
+	}
+};
 
-	// std::cout << "Configuration:\n"
-	//           << "  filename:   " << cfg.filename << "\n"
-	//           << "  type:       " << cfg.type << "\n"
-	//           << "  size:       " << cfg.size << " bytes\n"
-	//           << "  iodepth:    " << cfg.iodepth << "\n"
-	//           << "  block size: " << cfg.block_size << " bytes\n"
-	//           << "  mode:       " << (cfg.passthrough ? "passthrough" : "direct") << "\n";
+static int run_scenario(Scenario scenario, AgentSession *session);
 
-	NVMeDevice nvme;
-	open_nvme_ssd(cfg.filename, cfg.passthrough, &nvme);
+// Compare without an early exit, so the time taken does not tell how much of the token matched
+static bool token_matches(const std::string &given, const std::string &token)
+{
+	unsigned char diff = given.size() != token.size();
+	for (size_t i = 0; i < given.size() && i < token.size(); i++)
+	{
+		diff |= given[i] ^ token[i];
+	}
+	return diff == 0;
+}
 
-	// std::cout << "NVMeDevice:\n"
-	//           << "  fd:  " << nvme.fd << "\n"
-	//           << "  nsid:      " << nvme.nsid << "\n"
-	//           << "  lba_size:   " << nvme.lba_size << " bytes\n"
-	//           << "  nlba: " << nvme.nlba << "\n";
+// Child process of the agent: check the session token, then read the forwarded command line and run it
+static int run_agent_session(int fd, const std::string &token)
+{
+	AgentSession session {fd, {fd, {}}};
+	std::vector<std::string> args = {"rio"};
+	std::string line;
+	if (!session.in.read_line(&line) || line.compare(0, 6, "TOKEN ") != 0 || !token_matches(line.substr(6), token))
+	{
+		std::cerr << "Rejected a session without the agent's " << RIO_AGENT_TOKEN << std::endl;
+		return 1;
+	}
+	while (session.in.read_line(&line) && !line.empty())
+	{
+		if (line.compare(0, 4, "ARG ") == 0)
+			args.push_back(line.substr(4));
+	}
 
-	// Validate block size is a multiple of LBA size
-	if (cfg.block_size % nvme.lba_size != 0)
+	std::vector<char *> argv;
+	for (std::string &arg : args)
 	{
-		std::cerr << "Error: block size (" << cfg.block_size << ") must be a multiple of LBA size (" << nvme.lba_size
-		          << ")\n";
-		close(nvme.fd);
-		exit(1);
+		argv.push_back(strdup(arg.c_str()));
+	}
+	argv.push_back(nullptr);
+	optind = 0; // rescan from scratch
+	Scenario scenario = parse_args((int)args.size(), argv.data());
+	if (scenario.server_port || scenario.phases[0].jobs[0].client)
+	{
+		fatal_error("--server and --client cannot be forwarded to an agent");
 	}
 
-	struct io_uring ring;
-	setup_io_uring(&ring, cfg.iodepth, cfg.passthrough, cfg.submit_mode, cfg.iopoll);
+	int exit_code = run_scenario(scenario, &session);
+	send_line(fd, "DONE " + std::to_string(exit_code));
+	return exit_code;
+}
 
-	// Register the file descriptor for fixed file access (avoids per-I/O fd lookup)
-	int ret = io_uring_register_files(&ring, &nvme.fd, 1);
-	if (ret < 0)
+// --server: serve coordinators one session at a time, so two of them never share the agent's devices. Sessions run
+// whatever they are sent with the agent's privileges (any device, any output path), so every coordinator must present
+// the shared token, and the agent listens on loopback unless told otherwise.
+static int run_agent_server(const char *host, int port)
+{
+	const char *token = getenv(RIO_AGENT_TOKEN);
+	if (!token || strlen(token) < 16)
 	{
-		fatal_error("io_uring_register_files failed", ret);
+		std::cerr << "Error: set " << RIO_AGENT_TOKEN << " to a shared secret of at least 16 characters, on the "
+		          << "agent and on every coordinator" << std::endl;
+		return 1;
 	}
-	const int fixed_fd_idx = 0; // Index into registered files array
-
-	// Allocate IO contexts (buffer + timing info)
-	IOContext *io_contexts = new IOContext[cfg.iodepth];
-	size_t alignment = nvme.lba_size > 512 ? nvme.lba_size : 512;
-	for (int i = 0; i < cfg.iodepth; i++)
+	struct addrinfo hints = {};
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_PASSIVE | AI_NUMERICHOST;
+	struct addrinfo *addr;
+	if (getaddrinfo(host, std::to_string(port).c_str(), &hints, &addr) != 0)
+	{
+		std::cerr << "Error: --server needs a numeric address, not " << host << std::endl;
+		return 1;
+	}
+	int listen_fd = socket(addr->ai_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (listen_fd < 0)
 	{
-		io_contexts[i].buffer = alloc_aligned_buffer(cfg.block_size, alignment);
+		fatal_error("Failed to create the agent socket", -errno);
 	}
+	int on = 1;
+	setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+	if (bind(listen_fd, addr->ai_addr, addr->ai_addrlen) < 0 || listen(listen_fd, 8) < 0)
+	{
+		fatal_error("Failed to listen for coordinators", -errno);
+	}
+	freeaddrinfo(addr);
+	std::cout << "rio agent listening on " << host << " port " << port << std::endl;
 
-	// Register buffers for fixed buffer I/O (avoids per-I/O page table walks)
-	if (!cfg.passthrough)
+	for (;;)
 	{
-		struct iovec *iovecs = new struct iovec[cfg.iodepth];
-		for (int i = 0; i < cfg.iodepth; i++)
+		int fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+		if (fd < 0)
 		{
-			iovecs[i].iov_base = io_contexts[i].buffer;
-			iovecs[i].iov_len = cfg.block_size;
+			if (errno == EINTR)
+				continue;
+			fatal_error("accept failed", -errno);
 		}
-		ret = io_uring_register_buffers(&ring, iovecs, cfg.iodepth);
-		if (ret < 0)
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+		std::cout.flush();
+		pid_t pid = fork();
+		if (pid == 0)
 		{
-			fatal_error("io_uring_register_buffers failed", ret);
+			close(listen_fd);
+			exit(run_agent_session(fd, token));
 		}
-		delete[] iovecs;
+		close(fd);
+		if (pid < 0)
+		{
+			std::cerr << "Warning: fork failed: " << strerror(errno) << std::endl;
+			continue;
+		}
+		int status;
+		waitpid(pid, &status, 0);
+		std::cout << "Session ended with status " << (WIFEXITED(status) ? WEXITSTATUS(status) : -1) << std::endl;
 	}
+}
 
-	// Calculate workload parameters
-	uint64_t block_lbas = cfg.block_size / nvme.lba_size;
-	bool time_based = (cfg.runtime > 0);
-	uint64_t total_ops = time_based ? UINT64_MAX : cfg.size / cfg.block_size;
-	TimePoint deadline = time_based ? Clock::now() + std::chrono::seconds(cfg.runtime) : TimePoint {};
+static int connect_agent(const std::string &agent)
+{
+	std::string host;
+	std::string port = std::to_string(RIO_AGENT_PORT);
+	split_host_port(agent, &host, &port);
 
-	// Latency tracking
-	std::vector<double> latencies;
-	if (!time_based)
+	struct addrinfo hints = {};
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	struct addrinfo *addrs;
+	if (getaddrinfo(host.c_str(), port.c_str(), &hints, &addrs) != 0)
+	{
+		std::cerr << "Error: cannot resolve agent " << agent << std::endl;
+		exit(1);
+	}
+	int fd = -1;
+	for (struct addrinfo *a = addrs; a && fd < 0; a = a->ai_next)
+	{
+		fd = socket(a->ai_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		if (fd >= 0 && connect(fd, a->ai_addr, a->ai_addrlen) < 0)
+		{
+			close(fd);
+			fd = -1;
+		}
+	}
+	freeaddrinfo(addrs);
+	if (fd < 0)
 	{
-		latencies.reserve(total_ops);
+		std::cerr << "Error: cannot connect to agent " << agent << std::endl;
+		exit(1);
 	}
+	int on = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+	return fd;
+}
 
-	// Track progress
-	uint64_t submitted_ops = 0;
-	uint64_t completed_ops = 0;
-	int in_flight = 0;
+// --client: run the scenario on every agent at once and report the merged results of each phase and job
+static int run_coordinator(int argc, char **argv, const char *client)
+{
+	struct Agent
+	{
+		std::string name;
+		int fd;
+		LineReader in;
+	};
+	std::vector<Agent> agents;
+	std::istringstream list(client);
+	std::string name;
+	while (std::getline(list, name, ','))
+	{
+		int fd = connect_agent(name);
+		agents.push_back({name, fd, {fd, {}}});
+	}
 
-	// Record start time
-	TimePoint start_time = Clock::now();
+	// Forward the command line without --client
+	const char *token = getenv(RIO_AGENT_TOKEN);
+	if (!token)
+	{
+		std::cerr << "Error: set " << RIO_AGENT_TOKEN << " to the agents' shared secret" << std::endl;
+		exit(1);
+	}
+	for (Agent &agent : agents)
+	{
+		send_line(agent.fd, std::string("TOKEN ") + token);
+		for (int i = 1; i < argc; i++)
+		{
+			if (strcmp(argv[i], "--client") == 0)
+				i++;
+			else if (strncmp(argv[i], "--client=", 9) != 0)
+				send_line(agent.fd, std::string("ARG ") + argv[i]);
+		}
+		send_line(agent.fd, "");
+	}
 
-	bool is_write = (strcmp(cfg.type, "randwrite") == 0);
+	auto read_from = [&](Agent &agent, std::string *line)
+	{
+		if (!agent.in.read_line(line))
+		{
+			std::cerr << "Error: agent " << agent.name << " ended the session; see its output" << std::endl;
+			exit(1);
+		}
+	};
 
-	// Fill queue with initial operations
-	while (submitted_ops < total_ops && in_flight < cfg.iodepth)
+	int exit_code = 0;
+	std::string line;
+	for (;;)
 	{
-		uint64_t lba = random_lba(nvme.nlba, block_lbas);
-		int buf_idx = in_flight;
+		// Every agent reports READY for the same phase, or DONE
+		std::vector<std::string> replies;
+		for (Agent &agent : agents)
+		{
+			read_from(agent, &line);
+			replies.push_back(line);
+		}
+		if (replies[0].compare(0, 5, "DONE ") == 0)
+		{
+			for (size_t a = 0; a < agents.size(); a++)
+			{
+				if (replies[a].compare(0, 5, "DONE ") != 0)
+				{
+					std::cerr << "Error: agents disagree on the number of phases" << std::endl;
+					exit(1);
+				}
+				exit_code |= atoi(replies[a].c_str() + 5);
+			}
+			break;
+		}
+		for (const std::string &reply : replies)
+		{
+			if (reply != replies[0] || reply.compare(0, 6, "READY ") != 0)
+			{
+				std::cerr << "Error: agents disagree on the scenario: '" << reply << "'" << std::endl;
+				exit(1);
+			}
+		}
+
+		// Leave time for the START line to reach every agent
+		uint64_t start_ns = unix_time_ns() + 100000000;
+		for (Agent &agent : agents)
+		{
+			send_line(agent.fd, "START " + std::to_string(start_ns));
+		}
+
+		// Collect each agent's results, keyed by job name in order of appearance
+		std::vector<std::string> job_names;
+		std::vector<std::vector<ClusterResult>> per_agent; // job -> agent
+		for (size_t a = 0; a < agents.size(); a++)
+		{
+			for (read_from(agents[a], &line); line != "END"; read_from(agents[a], &line))
+			{
+				ClusterResult r;
+				int name_at = 0;
+				if (sscanf(line.c_str(), "RESULT %" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64
+				                         " %" SCNu64 " %n",
+				           &r.ops, &r.bytes, &r.errors, &r.elapsed_ns, &r.latency_sum_ns, &r.min_ns, &r.max_ns,
+				           &name_at) != 7 ||
+				    name_at == 0)
+				{
+					std::cerr << "Error: bad result from agent " << agents[a].name << std::endl;
+					exit(1);
+				}
+				std::string job = line.substr(name_at);
+				read_from(agents[a], &line);
+				std::istringstream hist(line.substr(std::min<size_t>(line.size(), 4)));
+				std::string entry;
+				while (hist >> entry)
+				{
+					int idx = atoi(entry.c_str());
+					if (idx >= 0 && idx < CLUSTER_HIST_BUCKETS)
+						r.hist[idx] = strtoull(entry.c_str() + entry.find(':') + 1, nullptr, 10);
+				}
 
-		io_contexts[buf_idx].submit_time = Clock::now();
+				size_t j = std::find(job_names.begin(), job_names.end(), job) - job_names.begin();
+				if (j == job_names.size())
+				{
+					job_names.push_back(job);
+					per_agent.emplace_back(agents.size());
+				}
+				per_agent[j][a] = r;
+			}
+		}
 
-		if (cfg.passthrough)
+		std::string phase = replies[0].substr(replies[0].find(' ', 6) + 1);
+		if (phase != "-")
 		{
-			if (is_write)
-				submit_write_passthrough(&ring, &nvme, fixed_fd_idx, io_contexts[buf_idx].buffer, lba, block_lbas,
-				                         buf_idx);
-			else
-				submit_read_passthrough(&ring, &nvme, fixed_fd_idx, io_contexts[buf_idx].buffer, lba, block_lbas,
-				                        buf_idx);
+			std::cout << "\nPhase " << phase << "\n";
 		}
-		else
+		for (size_t j = 0; j < job_names.size(); j++)
 		{
-			uint64_t offset = lba * nvme.lba_size;
-			if (is_write)
-				submit_write_direct(&ring, fixed_fd_idx, io_contexts[buf_idx].buffer, cfg.block_size, offset, buf_idx);
-			else
-				submit_read_direct(&ring, fixed_fd_idx, io_contexts[buf_idx].buffer, cfg.block_size, offset, buf_idx);
+			if (job_names.size() > 1 || job_names[j] != "-")
+			{
+				std::cout << "\nJob " << job_names[j] << "\n";
+			}
+			ClusterResult total;
+			for (const ClusterResult &r : per_agent[j])
+			{
+				total.merge(r);
+			}
+			std::cout << "\nCluster: " << agents.size() << " agent(s)";
+			print_metrics(total.metrics());
+			if (total.errors > 0)
+			{
+				std::cout << "  Failed I/Os: " << total.errors << "\n";
+			}
+			std::cout << "  Per agent:\n";
+			for (size_t a = 0; a < agents.size(); a++)
+			{
+				Metrics m = per_agent[j][a].metrics();
+				std::cout << "    " << std::left << std::setw(24) << agents[a].name << std::right << " IOPS "
+				          << std::fixed << std::setprecision(0) << m.iops << ", p50 " << std::setprecision(2) << m.p50
+				          << ", p99 " << m.p99 << " us\n";
+			}
 		}
+	}
 
-		submitted_ops++;
-		in_flight++;
+	for (Agent &agent : agents)
+	{
+		close(agent.fd);
 	}
+	return exit_code;
+}
 
-	// Submit initial batch (in SQPOLL mode, flushes SQ tail for kernel thread)
+static int run_scenario(Scenario scenario, AgentSession *session)
+{
+	expand_namespaces(&scenario);
+	apply_queue_layout(&scenario);
+	if (scenario.phases[0].jobs[0].isolation)
 	{
-		int ret = io_uring_submit(&ring);
-		if (ret < 0)
+		add_isolation_phases(&scenario);
+	}
+	const std::vector<Phase> &phases = scenario.phases;
+	const Config &run_cfg = phases[0].jobs[0]; // run-wide options are the same in every job
+	if (run_cfg.rt)
+	{
+		// Before anything is allocated, so MCL_FUTURE faults in every buffer and ring as it is created
+		enter_rt_mode(run_cfg.rt_nothp);
+		std::set<int> cpus;
+		std::set<std::string> targets;
+		for (const Phase &phase : phases)
 		{
-			fatal_error("io_uring_submit failed", ret);
+			for (const Config &cfg : phase.jobs)
+			{
+				cpus.insert(cfg.worker_cpus.begin(), cfg.worker_cpus.end());
+				targets.insert(cfg.filename);
+			}
+		}
+		if (cpus.empty())
+		{
+			cpu_set_t allowed;
+			sched_getaffinity(0, sizeof(allowed), &allowed);
+			for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+			{
+				if (CPU_ISSET(cpu, &allowed))
+				{
+					cpus.insert(cpu);
+				}
+			}
 		}
+		check_rt_environment({cpus.begin(), cpus.end()}, {targets.begin(), targets.end()});
 	}
 
-	// Main workload loop
-	// For time-based: run until deadline, then drain in-flight ops
-	while (in_flight > 0 || (!time_based && completed_ops < total_ops))
+	// Open every target once for the whole scenario; phases switching between them keep the descriptors
+	std::map<std::pair<std::string, bool>, NVMeDevice> devices;
+	auto device_of = [&](const Config &cfg) -> NVMeDevice & { return devices[{cfg.filename, cfg.passthrough}]; };
+	bool verify = false;
+	int total_workers = 0;
+	std::vector<Job> jobs(phases[0].jobs.size());
+	std::vector<std::string> poll_warned; // devices without poll queues, warned about once
+	for (const Phase &phase : phases)
 	{
-		struct io_uring_cqe *cqe;
-		int ret;
-
-		switch (cfg.submit_mode)
+		for (size_t j = 0; j < phase.jobs.size(); j++)
 		{
-		case SubmitMode::SUBMIT_AND_WAIT:
-			// Single syscall: submit pending SQEs and wait for completion
-			ret = io_uring_submit_and_wait(&ring, 1);
-			break;
+			const Config &cfg = phase.jobs[j];
+			NVMeDevice &nvme = device_of(cfg);
 
-		case SubmitMode::SUBMIT:
-			// Two syscalls: submit first, then wait separately
-			ret = io_uring_submit(&ring);
-			if (ret < 0)
+			// std::cout << "Configuration:\n"
+			//           << "  filename:   " << cfg.filename << "\n"
+			//           << "  type:       " << cfg.type << "\n"
+			//           << "  size:       " << cfg.size << " bytes\n"
+			//           << "  iodepth:    " << cfg.iodepth << "\n"
+			//           << "  block size: " << cfg.block_size << " bytes\n"
+			//           << "  mode:       " << (cfg.passthrough ? "passthrough" : "direct") << "\n";
+
+			if (nvme.lba_size == 0)
 			{
-				fatal_error("io_uring_submit failed", ret);
+				open_nvme_ssd(cfg.filename, cfg.passthrough, &nvme);
+			}
+			bool warned = std::find(poll_warned.begin(), poll_warned.end(), cfg.filename) != poll_warned.end();
+			if (cfg.iopoll && !warned && !read_queue_topology(cfg.filename).poll_queues)
+			{
+				poll_warned.push_back(cfg.filename);
+				std::cerr << "Warning: --iopoll on " << cfg.filename << ", which has no poll queues; I/O will fail "
+				          << "with EOPNOTSUPP. Load the nvme driver with poll_queues=N.\n";
 			}
-			ret = io_uring_wait_cqe(&ring, &cqe);
-			break;
 
-		case SubmitMode::SQPOLL:
-			// Flush SQ tail and wake kernel thread if idle; no actual submit syscall
-			io_uring_submit(&ring);
-			ret = io_uring_wait_cqe(&ring, &cqe);
-			break;
+			// std::cout << "NVMeDevice:\n"
+			//           << "  fd:  " << nvme.fd << "\n"
+			//           << "  nsid:      " << nvme.nsid << "\n"
+			//           << "  lba_size:   " << nvme.lba_size << " bytes\n"
+			//           << "  nlba: " << nvme.nlba << "\n";
+
+			// Validate block size is a multiple of LBA size
+			if (cfg.block_size % nvme.lba_size != 0)
+			{
+				std::cerr << "Error: block size (" << cfg.block_size << ") must be a multiple of LBA size ("
+				          << nvme.lba_size << ")\n";
+				close(nvme.fd);
+				exit(1);
+			}
+			if (cfg.trace && (cfg.block_size / nvme.lba_size > 4096 || nvme.nlba > (1ULL << 40) ||
+			                  nvme.lba_size != device_of(phases[0].jobs[0]).lba_size))
+			{
+				fatal_error(
+				    "--trace supports at most 4096 LBAs per I/O, 2^40 LBAs per device and one LBA size per run");
+			}
+			uint64_t region_base, region_count;
+			worker_region(cfg, nvme, cfg.numjobs - 1, &region_base, &region_count);
+			// Sequential and verified writes use a slice of the region per worker (the whole region with
+			// --offset_increment); the last worker's region is the smallest
+			uint64_t block_lbas = cfg.block_size / nvme.lba_size;
+			uint64_t slice_blocks = region_count / (cfg.offset_increment ? 1 : cfg.numjobs) / block_lbas;
+			bool verify_writes = cfg.verify && is_write_type(cfg.type);
+			bool sliced = is_sequential_type(cfg.type) || verify_writes;
+			if ((cfg.offset | cfg.io_range | cfg.offset_increment) % nvme.lba_size != 0 ||
+			    region_base + region_count > nvme.nlba || region_count < block_lbas || (sliced && slice_blocks == 0))
+			{
+				std::cerr << "Error: --offset, --io_range and --offset_increment must be multiples of the LBA size ("
+				          << nvme.lba_size << ") and give every worker at least one block within " << cfg.filename
+				          << (sliced ? " in its slice of the region\n" : "\n");
+				exit(1);
+			}
+			// Verified writes never overlap one in flight, so every slot needs a block of its own
+			if (verify_writes && slice_blocks < (uint64_t)cfg.iodepth)
+			{
+				std::cerr << "Error: --verify writes need at least --iodepth (" << cfg.iodepth
+				          << ") blocks per worker, but each worker's slice of " << cfg.filename << " holds "
+				          << slice_blocks << "\n";
+				exit(1);
+			}
+			verify |= cfg.verify;
+
+			// Size each job's worker pool, slots and buffers for the most demanding phase
+			Job &job = jobs[j];
+			job.workers.resize(std::max<size_t>(job.workers.size(), cfg.numjobs), nullptr);
+			for (Worker *&w : job.workers)
+			{
+				if (!w)
+				{
+					w = new Worker;
+					total_workers++;
+				}
+				w->slot_capacity = std::max(w->slot_capacity, cfg.iodepth);
+				w->buffer_count =
+				    std::max(w->buffer_count, cfg.buffer_pool ? std::min(cfg.buffer_pool, cfg.iodepth) : cfg.iodepth);
+				w->buffer_size = std::max(w->buffer_size, cfg.block_size);
+				w->has_dedupe |= is_write_type(cfg.type) && cfg.dedupe_percentage > 0;
+			}
 		}
+	}
+	if (run_cfg.trace && total_workers > 1024)
+	{
+		fatal_error("--trace supports at most 1024 workers");
+	}
+	if (verify)
+	{
+		crc32c_init();
+	}
 
-		if (ret < 0)
+	// --buffer_pool: I/O buffer memory against one buffer per slot
+	uint64_t buffer_bytes = 0;
+	uint64_t slot_bytes = 0;
+	for (const Job &job : jobs)
+	{
+		for (const Worker *w : job.workers)
 		{
-			fatal_error("io_uring wait failed", ret);
+			buffer_bytes += (uint64_t)w->buffer_count * w->buffer_size;
+			slot_bytes += (uint64_t)w->slot_capacity * w->buffer_size;
 		}
+	}
+	if (buffer_bytes < slot_bytes)
+	{
+		std::cout << "Buffer pool: " << std::fixed << std::setprecision(2) << buffer_bytes / 1048576.0
+		          << " MiB of I/O buffers instead of " << slot_bytes / 1048576.0 << " MiB, saving "
+		          << (slot_bytes - buffer_bytes) / 1048576.0 << " MiB\n";
+	}
 
-		// Process completions
-		unsigned head;
-		unsigned count = 0;
+	// Live counters for the metrics exporter (only maintained when an exporter is configured). Series are labelled
+	// with the job's settings in the first phase and keep counting across phases.
+	bool export_metrics = run_cfg.metrics_file || run_cfg.metrics_socket;
+	MetricsExporter exporter;
+	TraceWriter trace_writer;
+	RunControl ctl;
+	ctl.go.expected = total_workers + 1;
+	ctl.done.expected = total_workers + 1;
 
-		io_uring_for_each_cqe(&ring, head, cqe)
+	int next_worker_id = 0;
+	for (size_t j = 0; j < jobs.size(); j++)
+	{
+		for (Worker *w : jobs[j].workers)
 		{
-			if (cqe->res < 0)
+			w->id = next_worker_id++;
+			w->ctl = &ctl;
+			if (export_metrics)
+			{
+				w->live = new LiveStats;
+				exporter.sources.push_back({&phases[0].jobs[j], w->live});
+			}
+			if (run_cfg.trace)
 			{
-				fatal_error("I/O operation failed", cqe->res);
+				w->trace = alloc_trace_ring();
+				trace_writer.rings.push_back(w->trace);
 			}
+		}
+	}
 
-			int buf_idx = (int)(uintptr_t)io_uring_cqe_get_data(cqe);
+	if (export_metrics)
+	{
+		start_metrics_exporter(&exporter, &run_cfg);
+	}
+	if (run_cfg.trace)
+	{
+		start_trace_writer(&trace_writer, run_cfg.trace, device_of(run_cfg).lba_size);
+	}
 
-			// Calculate latency for this operation
-			TimePoint complete_time = Clock::now();
-			auto duration =
-			    std::chrono::duration_cast<std::chrono::nanoseconds>(complete_time - io_contexts[buf_idx].submit_time);
-			double latency_us = duration.count() / 1000.0;
-			latencies.push_back(latency_us);
+	sched_getaffinity(0, sizeof(ctl.default_cpus), &ctl.default_cpus);
+	ctl.log_committer.thread = std::thread(log_committer_loop, &ctl.log_committer);
+	ctl.realtime = run_cfg.rt;
+	ProcessRendezvous rendezvous;
+	if (run_cfg.sync_name)
+	{
+		rendezvous.open(run_cfg.sync_name, run_cfg.sync_processes);
+	}
+	const char *phase_name = nullptr;
+	if (run_cfg.sync_name || session)
+	{
+		ctl.start.before_release = [&]
+		{
+			if (run_cfg.sync_name)
+				rendezvous.wait();
+			if (session)
+				session->wait_start(phase_name);
+		};
+	}
+	ctl.origin = Clock::now();
+	for (Job &job : jobs)
+	{
+		for (Worker *w : job.workers)
+		{
+			w->thread = std::thread(worker_main, w);
+		}
+	}
 
-			completed_ops++;
-			in_flight--;
-			count++;
+	OffsetLogs recorded;
+	OffsetLogs replay = run_cfg.replay_offsets ? read_offset_logs(run_cfg.replay_offsets) : OffsetLogs {};
 
-			// Resubmit if more work to do (check deadline for time-based mode)
-			bool should_submit = time_based ? (Clock::now() < deadline) : (submitted_ops < total_ops);
-			if (should_submit)
-			{
-				uint64_t lba = random_lba(nvme.nlba, block_lbas);
+	int exit_code = 0;
+	bool named = jobs.size() > 1 || run_cfg.name;
+	std::vector<std::vector<Metrics>> results(phases.size(), std::vector<Metrics>(jobs.size()));
+	for (size_t p = 0; p < phases.size(); p++)
+	{
+		const Phase &phase = phases[p];
+		if (phase.idle_sec > 0)
+		{
+			std::this_thread::sleep_for(std::chrono::seconds(phase.idle_sec));
+		}
 
-				io_contexts[buf_idx].submit_time = Clock::now();
+		// Split each job across its workers: --size and --rate_iops are shared out. Sequential and verified writes
+		// get a slice of the job's region per worker, unless --offset_increment already gives each worker its own.
+		// Workers beyond this phase's --numjobs sit it out.
+		int active_workers = 0;
+		for (size_t j = 0; j < jobs.size(); j++)
+		{
+			Job &job = jobs[j];
+			job.cfg = &phase.jobs[j];
+			job.nvme = &device_of(*job.cfg);
+			job.active.clear();
 
-				if (cfg.passthrough)
+			const Config &cfg = *job.cfg;
+			uint64_t block_lbas = cfg.block_size / job.nvme->lba_size;
+			uint64_t total_ops = cfg.size / cfg.block_size;
+			for (int k = 0; k < (int)job.workers.size(); k++)
+			{
+				Worker *w = job.workers[k];
+				w->cfg = k < cfg.numjobs && (phase.solo < 0 || phase.solo == (int)j) ? &cfg : nullptr;
+				if (!w->cfg)
+				{
+					continue;
+				}
+				w->nvme = job.nvme;
+				w->cpu = cfg.worker_cpus.empty() ? -1 : cfg.worker_cpus[k];
+				w->total_ops = cfg.runtime > 0 ? UINT64_MAX
+				                               : total_ops / cfg.numjobs + ((uint64_t)k < total_ops % cfg.numjobs);
+				w->rate_iops = cfg.rate_iops / cfg.numjobs + ((uint64_t)k < cfg.rate_iops % cfg.numjobs);
+				w->phase = (int)p;
+				w->record = run_cfg.record_offsets ? &recorded[{(int)p, w->id}] : nullptr;
+				w->replay = nullptr;
+				if (run_cfg.replay_offsets)
+				{
+					auto it = replay.find({(int)p, w->id});
+					if (it == replay.end())
+					{
+						std::cerr << "Error: --replay_offsets has no offsets for worker " << w->id << " in phase "
+						          << p << "; replay with the options of the recording\n";
+						exit(1);
+					}
+					w->replay = &it->second;
+					w->total_ops = it->second.count;
+				}
+				worker_region(cfg, *job.nvme, k, &w->region_base, &w->region_count);
+				if (cfg.offset_increment)
 				{
-					if (is_write)
-						submit_write_passthrough(&ring, &nvme, fixed_fd_idx, io_contexts[buf_idx].buffer, lba,
-						                         block_lbas, buf_idx);
-					else
-						submit_read_passthrough(&ring, &nvme, fixed_fd_idx, io_contexts[buf_idx].buffer, lba,
-						                        block_lbas, buf_idx);
+					w->lba_base = w->region_base;
+					w->lba_count = w->region_count / block_lbas * block_lbas;
 				}
 				else
 				{
-					uint64_t offset = lba * nvme.lba_size;
-					if (is_write)
-						submit_write_direct(&ring, fixed_fd_idx, io_contexts[buf_idx].buffer, cfg.block_size, offset,
-						                    buf_idx);
-					else
-						submit_read_direct(&ring, fixed_fd_idx, io_contexts[buf_idx].buffer, cfg.block_size, offset,
-						                   buf_idx);
+					uint64_t slice = w->region_count / cfg.numjobs / block_lbas * block_lbas;
+					w->lba_base = w->region_base + k * slice;
+					w->lba_count = slice;
 				}
-
-				submitted_ops++;
-				in_flight++;
+				job.active.push_back(w);
+				active_workers++;
 			}
 		}
+		ctl.start.expected = active_workers;
+		phase_name = phase.name;
 
-		io_uring_cq_advance(&ring, count);
+		ctl.go.wait();
+		ctl.done.wait();
+
+		if (phase.name)
+		{
+			std::cout << "\nPhase " << phase.name;
+			if (phase.idle_sec > 0)
+			{
+				std::cout << " (after " << phase.idle_sec << " s idle)";
+			}
+			std::cout << "\n";
+		}
+		for (size_t j = 0; j < jobs.size(); j++)
+		{
+			if (!jobs[j].active.empty())
+			{
+				exit_code |= report_job(jobs[j], ctl.start.start_time, named, phase.name, &results[p][j]);
+			}
+		}
+		if (session)
+		{
+			session->send_results(jobs, ctl.start.start_time);
+		}
 	}
 
-	// Record end time and calculate elapsed
-	TimePoint end_time = Clock::now();
-	double elapsed_sec = std::chrono::duration<double>(end_time - start_time).count();
+	if (run_cfg.sync_name)
+	{
+		rendezvous.close_object();
+	}
 
-	// Print metrics
-	print_metrics(latencies, elapsed_sec, completed_ops, cfg.block_size);
+	ctl.finished = true;
+	ctl.go.wait();
+	for (Job &job : jobs)
+	{
+		for (Worker *w : job.workers)
+		{
+			w->thread.join();
+		}
+	}
+	ctl.log_committer.stop.store(true, std::memory_order_release);
+	ctl.log_committer.thread.join();
 
-	// Free buffers
-	for (int i = 0; i < cfg.iodepth; i++)
+	if (export_metrics)
+	{
+		stop_metrics_exporter(&exporter);
+	}
+	if (run_cfg.trace)
+	{
+		stop_trace_writer(&trace_writer);
+	}
+	if (run_cfg.record_offsets)
+	{
+		write_offset_logs(run_cfg.record_offsets, recorded);
+	}
+	if (!scenario.sweep.empty())
+	{
+		print_sweep_table(scenario, results, phases[0].jobs, named);
+	}
+	if (run_cfg.isolation)
 	{
-		free(io_contexts[i].buffer);
+		print_isolation_table(results, phases[0].jobs);
 	}
-	delete[] io_contexts;
 
-	io_uring_queue_exit(&ring);
+	for (Job &job : jobs)
+	{
+		for (Worker *w : job.workers)
+		{
+			delete w->live;
+			if (w->trace)
+			{
+				free(w->trace->events);
+				delete w->trace;
+			}
+			delete w;
+		}
+	}
+	for (auto &entry : devices)
+	{
+		close(entry.second.fd);
+	}
+	return exit_code;
+}
 
-	close(nvme.fd);
-	return 0;
+int main(int argc, char **argv)
+{
+	Scenario scenario = parse_args(argc, argv);
+	if (scenario.server_port)
+	{
+		return run_agent_server(scenario.server_addr, scenario.server_port);
+	}
+	if (scenario.phases[0].jobs[0].client)
+	{
+		return run_coordinator(argc, argv, scenario.phases[0].jobs[0].client);
+	}
+	return run_scenario(scenario, nullptr);
 }
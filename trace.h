@@ -0,0 +1,47 @@
+#ifndef RIO_TRACE_H
+#define RIO_TRACE_H
+
+#include <cstdint>
+
+// On-disk format of `rio --trace` files, shared with rio-analyze.
+//
+// A trace is a TRACE_HEADER_SIZE header followed by fixed-width TraceEvent records, written as chunks of one
+// worker's events with the chunks of different workers interleaved. Within a worker, events are in completion
+// order; nothing is sorted, so readers must not assume a global time order or one run of events per worker.
+
+constexpr char TRACE_MAGIC[8] = {'R', 'I', 'O', 'T', 'R', 'A', 'C', 'E'};
+constexpr uint32_t TRACE_VERSION = 1;
+constexpr uint64_t TRACE_HEADER_SIZE = 4096; // keeps event data aligned for O_DIRECT
+
+struct TraceHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t event_size;
+	uint32_t lba_size;
+	uint32_t workers;
+	uint64_t events;         // filled in when the trace is closed
+	uint64_t dropped;        // events lost because the writer fell behind
+	uint64_t start_unix_ns;  // wall-clock time of the trace origin
+};
+
+enum TraceOp : uint8_t
+{
+	TRACE_READ = 0,
+	TRACE_WRITE = 1,
+};
+
+struct TraceEvent
+{
+	uint64_t submit_ns;   // relative to the trace origin
+	uint64_t complete_ns; // relative to the trace origin
+	uint64_t lba : 40;
+	uint64_t blocks : 12; // transfer length in LBAs, minus one
+	uint64_t op : 1;      // TraceOp
+	uint64_t failed : 1;  // completed with an error
+	uint64_t worker : 10;
+};
+
+static_assert(sizeof(TraceEvent) == 24, "trace events are 24 bytes on disk");
+
+#endif